@@ -28,6 +28,8 @@ public:
     return this->Ty;
   }
 
+  bool hasQualType() const { return Ty != nullptr; }
+
   const QualType *getQualType() const {
     if (Ty == nullptr) {
       throw std::runtime_error("Type not set for ExprNode");
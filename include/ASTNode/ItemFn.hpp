@@ -38,6 +38,7 @@ struct VarDecl {
   std::string Name;
   const QualType *Ty;
   bool mut;
+  bool addrTaken = false; // borrowed somewhere in the body
 };
 
 class ItemFn : public ItemAssociatedNode
@@ -80,6 +81,13 @@ public:
     return it->second;
   }
 
+  void setVarAddrTaken(const std::string &Name) {
+    auto it = VarDecls.find(Name);
+    if (it != VarDecls.end()) {
+      it->second.addrTaken = true;
+    }
+  }
+
   bool getVarMut(const std::string &Name) const {
     auto it = getVarDecl(Name);
     return it.mut;
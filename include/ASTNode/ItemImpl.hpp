@@ -1,6 +1,7 @@
 #ifndef ITEMIMPL_HPP
 #define ITEMIMPL_HPP
 #include "ItemNode.hpp"
+#include <list>
 class TypeNode;
 
 class ItemImpl : public ItemNode
@@ -8,10 +9,10 @@ class ItemImpl : public ItemNode
 public:
   std::string identifier;
   std::shared_ptr<TypeNode> type;
-  std::vector<std::shared_ptr<ItemAssociatedNode>> associated_items;
+  std::list<std::shared_ptr<ItemAssociatedNode>> associated_items; // list so impls can be spliced
 
   ItemImpl(std::string identifier, std::shared_ptr<TypeNode> type,
-    std::vector<std::shared_ptr<ItemAssociatedNode>> &&associated_items): identifier(identifier), 
+    std::list<std::shared_ptr<ItemAssociatedNode>> &&associated_items): identifier(identifier), 
     type(std::move(type)), associated_items(std::move(associated_items)), ItemNode(K_ItemImpl){}
   void accept(ASTVisitor &visitor) override {visitor.visit(*this);}
 };
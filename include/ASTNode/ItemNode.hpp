@@ -1,12 +1,30 @@
 #ifndef ITEMNODE_HPP
 #define ITEMNODE_HPP
 #include "ASTNode.hpp"
+#include <cstddef>
 
 class ItemNode : public ASTNode
 {
+private:
+  bool removed = false; // merged into another item or consumed by the checker
+  std::size_t tokBegin = 0, tokEnd = 0; // [begin, end) in the token stream
+
 public:
   ItemNode(TypeID Tid) : ASTNode(Tid) {}
   virtual void accept(ASTVisitor &visitor) = 0;
+
+  bool isRemoved(void) const { return removed; }
+
+  void setRemoved(bool r) { removed = r; }
+
+  void setTokenRange(std::size_t begin, std::size_t end) {
+    tokBegin = begin;
+    tokEnd = end;
+  }
+
+  std::size_t getTokenBegin(void) const { return tokBegin; }
+
+  std::size_t getTokenEnd(void) const { return tokEnd; }
 };
 
 class ItemAssociatedNode : public ItemNode
@@ -8,7 +8,7 @@ enum PathType { Identifier, Self, self };
 
 class Path : ASTNode {
 public:
-  const QualType *Ty;
+  const QualType *Ty = nullptr;
 
   PathType type;
   std::string identifier;
@@ -6,7 +6,7 @@
 class TypeNode : public ASTNode
 {
 public:
-  const QualType *Ty;
+  const QualType *Ty = nullptr; // resolved once by the checker
 
   TypeNode(TypeID Tid) : ASTNode(Tid) {}
   virtual void accept(ASTVisitor &visitor) = 0;
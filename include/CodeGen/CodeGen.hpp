@@ -39,12 +39,15 @@
 #include "../ASTNode/TypeUnit.hpp"
 #include "../Semantic/SymTable.hpp"
 #include "../Semantic/Type.hpp"
+#include "SSABuilder.hpp"
 #include <cassert>
 #include <cstdint> // fix missing uint64_t
 #include <llvm/IR/IRBuilder.h>
 #include <memory>
+#include <ostream>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 class CodeGen {
@@ -56,20 +59,68 @@ private:
   llvm::Module &Module;
   llvm::IRBuilder<> Builder;
   llvm::BasicBlock *Exit;
-  llvm::Value *ReturnValue;
+  llvm::Value *ReturnValue; // sret pointer, or the phi in Exit for scalars
 
 private:
   std::unordered_map<std::string, llvm::StructType *> StructTyDef;
+  // element index of each source field, for structs laid out reordered
+  std::unordered_map<std::string, std::vector<unsigned>> FieldSlots;
   std::unordered_map<std::string, llvm::Value *> AllocaAddr;
+  SSABuilder SSA; // scalar locals that are never borrowed
+  std::unordered_map<llvm::Constant *, llvm::GlobalVariable *> ConstantPool;
+  // one private global per distinct string literal
+  std::unordered_map<std::string, llvm::GlobalVariable *> StringPool;
+  std::unordered_set<const llvm::Value *> StringLiterals; // its globals
+  // allocas started in each enclosing block & expression statement, ended
+  // with it so that stack coloring can overlap disjoint ones
+  std::vector<std::vector<llvm::AllocaInst *>> LiveSlots;
 
   const StructQualType *CurrentImpl = nullptr; // 当前正在处理的 impl 块对应的结构体类型
   ItemFn *CurrentFn = nullptr; // 当前正在编译的函数 AST 节点。
-  llvm::BasicBlock *CurrentHeadBB = nullptr; // 当前控制流结构的“起始/条件”基本块
+  llvm::BasicBlock *CurrentLatchBB = nullptr; // 当前循环的 latch 基本块，continue 跳转至此
   llvm::BasicBlock *CurrentAfterBB = nullptr; // 当前控制流结构的“结束/后续”基本块
   llvm::Value *CurrentLoopRes = nullptr; // 当前循环的“返回值”存储位置
+  // address the aggregate InPlaceExpr should be constructed at
+  const ExprNode *InPlaceExpr = nullptr;
+  llvm::Value *InPlaceAddr = nullptr;
+  // incoming values of the current loop's result phi, for scalar results
+  std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> *CurrentLoopBreaks = nullptr;
+  // calls whose value is the current function's result
+  std::unordered_set<const ExprNode *> TailCalls;
+  // where a self call among them starts the body over, after the parameters
+  llvm::BasicBlock *TailRecurseBB = nullptr;
+  // slots of parameters that are never reassigned
+  std::unordered_set<const llvm::Value *> ParamSlots;
 
   llvm::Type *ImplType;
 
+  bool WholeProgram = false; // only what main reaches is kept
+  unsigned Threads = 1; // bodies emitted in this many partitions at once
+  // in a partition, the partition of each item of the crate
+  const std::vector<unsigned> *ItemPartition = nullptr;
+  unsigned Partition = 0;
+  bool ReorderFields = false; // fields of internal structs sorted by alignment
+  bool BoundsChecks = false; // an out of range index exits with 101
+  // llvm.loop hints asking for every loop to be vectorized / unrolled
+  bool VectorizeLoops = false;
+  bool UnrollLoops = false;
+  // per function, the block every failing bounds check branches to
+  std::unordered_map<llvm::Function *, llvm::BasicBlock *> BoundsFailBB;
+  unsigned NumBoundsChecks = 0;        // indexing that needs a check
+  unsigned NumBoundsChecksFolded = 0;  // constant index, no check emitted
+  unsigned NumBoundsChecksRemoved = 0; // proven after lowering
+
+  // aggregates up to this many bytes are copied with a load/store pair
+  static const uint64_t MaxInlineCopySize = 16;
+  // constant aggregates up to this many bytes are copied from a constant pool
+  static const uint64_t MaxConstantPoolSize = 4096;
+  // width of the stores filling a repeat-array with a runtime value
+  static const uint64_t VectorStoreSize = 16;
+  // aggregate arguments above this many bytes are passed by pointer
+  static const uint64_t MaxDirectArgSize = 16;
+  // shorter equality chains stay compare & branch
+  static const unsigned MinSwitchCases = 3;
+
 public:
   CodeGen(const Crate &Prog, const SymTable &Syms, llvm::LLVMContext &Context,
           llvm::Module &Module);
@@ -77,21 +128,77 @@ public:
   ~CodeGen() = default;
   bool emit();
 
+  void setWholeProgram(bool V) { WholeProgram = V; }
+  void setReorderFields(bool V) { ReorderFields = V; }
+  void setThreads(unsigned V) { Threads = V; }
+  void setBoundsChecks(bool V) { BoundsChecks = V; }
+  void setVectorizeLoops(bool V) { VectorizeLoops = V; }
+  void setUnrollLoops(bool V) { UnrollLoops = V; }
+  void reportBoundsChecks(std::ostream &OS) const;
+
 private:
   std::vector<llvm::Type *> getFnParamTypes(const FnParameters &FnParams);
 
   llvm::Type *convertType(const QualType *Ty);
+  // whether a by-value parameter of type Ty is passed as a pointer to a
+  // copy the caller owns
+  bool isIndirectParam(const QualType *Ty);
+  llvm::Type *convertParamType(const QualType *Ty);
 
   void emitItemNode(const ItemNode &N);
   llvm::Value *emitExprNode(const ExprNode &N);
   llvm::Type *emitTypeNode(const TypeNode &N);
   void emitPatternNode(const PatternNode &N);
   llvm::Value *getValue(llvm::Value *value, const QualType *Ty);
+  // a string literal is the pointer itself, not a place holding one
+  bool isStringLiteral(const llvm::Value *V) const { return StringLiterals.count(V); }
 
   void createMemCpy(llvm::Value *Dest, llvm::Value *Src, llvm::Type *Ty);
+  // emit an aggregate expression into Dest, constructors write there in place
+  void emitExprInto(const ExprNode &N, llvm::Value *Dest);
+  // the in-place destination of N, nullptr if it should make its own
+  llvm::Value *takeInPlaceAddr(const ExprNode &N);
+  // attributes following from the signature: sret, reference & indirect
+  // params, nounwind
+  void addFnAttrs(llvm::Function *Fn, const FuncQualType *FnTy);
+  // memory(none) & willreturn for functions touching only their own stack
+  void inferFnAttrs();
+  void removeUnreachableFns();
+  // emit the bodies on Threads threads, each into a context & module of
+  // its own, and link the partitions into Module
+  void emitParallel();
+  // functions & impls spread over Threads partitions, balanced by size
+  std::vector<unsigned> partitionItems() const;
+  // branch to the function's failure block unless Idx < Length
+  void emitBoundsCheck(llvm::Value *Idx, uint64_t Length);
+  // drop the checks scalar evolution proves in range, e.g. by a dominating
+  // loop condition
+  void eliminateBoundsChecks();
+  // memset for byte splats, otherwise a copy from a private constant global
+  void createConstantInit(llvm::Value *Dest, llvm::Constant *Init);
+  llvm::GlobalVariable *getConstantPoolEntry(llvm::Constant *Init);
+  // fold an expression without emitting code, nullptr if not a constant
+  llvm::Constant *getConstant(const ExprNode &N);
+
+  // whether a local of type Ty is kept in SSA form instead of an alloca
+  bool isSSALocal(const std::string &Name, llvm::Type *Ty) const;
+  // name of the SSA local an assignment writes to, empty if it is in memory
+  std::string getSSAPlace(const ExprNode &N) const;
+  // V converted to the integer type To, widened as From's signedness says
+  llvm::Value *castInt(llvm::Value *V, const QualType *From, llvm::Type *To);
+  // phi of the values flowing into the current block, poison if none does
+  llvm::Value *createMergePhi(
+      llvm::Type *Ty, const std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> &Incoming,
+      const llvm::Twine &Name);
 
   llvm::AllocaInst *createAlloca(llvm::Type *Ty, llvm::Value *ArraySize = nullptr,
                            const llvm::Twine &Name = "");
+  void pushLifetimeScope() { LiveSlots.emplace_back(); }
+  // end the innermost scope's slots, or hand them to the enclosing scope
+  // when Escaping, i.e. a value of the scope points into them
+  void popLifetimeScope(bool Escaping);
+  // Slot lives for the whole function, wherever it is referred to
+  void pinLifetime(llvm::Value *Slot);
   // Value *emitExprWithoutBlockNode(const ExprWithoutBlockNode &N);
   // Value *emitExprWithBlockNode(const ExprWithBlockNode &N);
   // Value *emitExprArrayNode(const ExprArrayNode &N);
@@ -102,6 +209,15 @@ private:
   void emitStmtNode(const StmtNode &N);
 
   void emitStructDefination();
+  // Ty's body, after the bodies of the structs it holds by value
+  void emitStructBody(const StructQualType *Ty,
+                      std::unordered_map<std::string, bool> &Done,
+                      const std::unordered_set<std::string> &Escaping);
+  // structs reachable from the signature of main or a runtime function,
+  // their layout is part of the ABI
+  std::unordered_set<std::string> collectEscapingStructs();
+  // element index of Field in Ty's LLVM struct
+  unsigned getFieldSlot(const StructQualType *Ty, const std::string &Field);
 
   std::string mangleFnName(std::string StructName, std::string FnName);
 
@@ -138,14 +254,43 @@ private:
   llvm::Value *emitExprArrayAbbreviate(const ExprArrayAbbreviate &N);
   llvm::Value *emitExprIndex(const ExprIndex &N);
   llvm::Value *emitExprStruct(const ExprStruct &N);
+  // an argument as the callee expects it, a copy's address if indirect
+  llvm::Value *emitArg(const ExprNode &Arg, const QualType *ParamTy);
   llvm::Value *emitExprCall(const ExprCall &N);
+  // a self call in tail position: the arguments become the parameters and the
+  // body starts over; false if one of them may point into this frame
+  bool emitTailRecursion(const std::vector<llvm::Value *> &Args);
+  // musttail & return right away when Call's signature is the caller's, else
+  // tail, as long as no argument may point into the caller's frame
+  void emitTailCall(llvm::CallInst *Call);
+  // whether V is no address, or one that cannot be into the current frame
+  bool isFrameIndependent(const llvm::Value *V) const;
   llvm::Value *emitExprMethodCall(const ExprMethodCall &N);
   llvm::Value *emitExprField(const ExprField &N);
   llvm::Value *emitExprLoopInfinite(const ExprLoopInfinite &N);
   llvm::Value *emitExprLoopPredicate(const ExprLoopPredicate &N);
+  // the single back edge from LatchBB to HeaderBB, carrying the llvm.loop
+  // hints; a latch nothing reaches is dropped instead. No loop is marked
+  // mustprogress, one spinning without side effects is well-defined
+  void emitLoopLatch(llvm::BasicBlock *LatchBB, llvm::BasicBlock *HeaderBB);
   llvm::Value *emitExprBreak(const ExprBreak &N);
   llvm::Value *emitExprContinue(const ExprContinue &N);
   llvm::Value *emitExprIf(const ExprIf &N);
+  // an arm of an if or switch: its value into Slot or Results, then to MergeBB
+  void emitBranchArm(const ExprNode &Arm, llvm::AllocaInst *Slot, llvm::Type *Ty,
+                     std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> &Results,
+                     llvm::BasicBlock *MergeBB);
+  // a literal, enum variant or const item, possibly negated or cast
+  bool isCaseLabel(const ExprNode &N) const;
+  using SwitchCase = std::pair<llvm::ConstantInt *, const ExprIf *>;
+  // for `if x == A {..} else if x == B {..} else ..`, x, a case per branch
+  // and the else after the last one; nullptr if the chain is too short to
+  // be worth a switch
+  const ExprNode *matchSwitchChain(const ExprIf &N, std::vector<SwitchCase> &Cases,
+                                   const ExprNode *&Default);
+  llvm::Value *emitSwitchChain(const ExprIf &N, const ExprNode &Scrutinee,
+                               const std::vector<SwitchCase> &Cases,
+                               const ExprNode *Default);
   llvm::Value *emitExprReturn(const ExprReturn &N);
   llvm::Value *emitExprUnderscore(const ExprUnderscore &N);
 
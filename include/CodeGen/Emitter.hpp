@@ -0,0 +1,51 @@
+#ifndef EMITTER_HPP
+#define EMITTER_HPP
+
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Writes the emitted module as textual IR or bitcode, or lowers it in-process through a
+// host TargetMachine to assembly / an object file / a linked executable.
+class Emitter {
+public:
+  enum Kind { IR, BC, Asm, Obj, Exe };
+
+private:
+  llvm::Module &Module;
+  std::unique_ptr<llvm::TargetMachine> Machine;
+
+public:
+  explicit Emitter(llvm::Module &Module) : Module(Module) {}
+
+  // "ir", "bc", "asm", "obj" or "exe"
+  static Kind parseKind(const std::string &Name);
+
+  // set the host triple & data layout on the module, call before optimizing
+  void initTarget();
+  llvm::TargetMachine *getTargetMachine() const { return Machine.get(); }
+
+  // an empty Path writes to stdout (a.out for Exe); Runtime is the object
+  // holding the builtin functions, linked into an executable
+  void write(Kind K, const std::string &Path, const std::string &Runtime);
+
+  // optimizes one partition, with the target machine lowering it
+  using OptimizeFn = std::function<void(llvm::Module &, llvm::TargetMachine *)>;
+  // Obj or Exe from up to Threads partitions of the module, each optimized
+  // & lowered on a thread of its own; the objects are joined by cc
+  void writeSplit(Kind K, const std::string &Path, const std::string &Runtime,
+                  unsigned Threads, const OptimizeFn &Optimize);
+
+private:
+  static std::unique_ptr<llvm::TargetMachine> createTargetMachine();
+  void writeNative(Kind K, llvm::raw_pwrite_stream &OS);
+  // an executable, or with Relocatable a single object, from Inputs
+  void link(const std::vector<std::string> &Inputs, const std::string &Out,
+            bool Relocatable);
+};
+
+#endif // EMITTER_HPP
@@ -0,0 +1,26 @@
+#ifndef JITRUNNER_HPP
+#define JITRUNNER_HPP
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <memory>
+#include <string>
+
+// JIT-compiles the module with ORC LLJIT and calls its main in-process.
+// Builtin functions come from the runtime object (or shared library) and
+// libc symbols from the compiler process itself.
+class JITRunner {
+private:
+  std::unique_ptr<llvm::LLVMContext> Context;
+  std::unique_ptr<llvm::Module> Module;
+
+public:
+  JITRunner(std::unique_ptr<llvm::LLVMContext> Context,
+            std::unique_ptr<llvm::Module> Module)
+      : Context(std::move(Context)), Module(std::move(Module)) {}
+
+  // returns the exit status of main, unless the program calls exit itself
+  int run(const std::string &Runtime);
+};
+
+#endif // JITRUNNER_HPP
@@ -0,0 +1,22 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+// Runs the default new-pass-manager pipeline on the emitted module.
+class Optimizer {
+private:
+  unsigned OptLevel; // 0-3, as -O<n>
+  bool TimePasses;   // report time spent in each pass to stderr
+  bool BoundsChecks; // split loops so their range checks run outside
+
+public:
+  Optimizer(unsigned OptLevel, bool TimePasses, bool BoundsChecks = false)
+      : OptLevel(OptLevel), TimePasses(TimePasses), BoundsChecks(BoundsChecks) {}
+
+  // Machine may be null, target independent defaults are used then
+  void run(llvm::Module &Module, llvm::TargetMachine *Machine = nullptr);
+};
+
+#endif // OPTIMIZER_HPP
@@ -0,0 +1,53 @@
+#ifndef SSABUILDER_HPP
+#define SSABUILDER_HPP
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/ValueHandle.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Builds SSA form for scalar locals while the IR is emitted, without
+// allocas (Braun et al., "Simple and Efficient Construction of Static
+// Single Assignment Form", CC 2013).
+// A block is sealed once all of its predecessors are known; reads in a
+// block that is not sealed yet leave an incomplete phi behind.
+class SSABuilder {
+private:
+  struct Variable {
+    llvm::Type *Ty;
+    // definition reaching the end of each block, RAUW follows removed phis
+    llvm::DenseMap<llvm::BasicBlock *, llvm::WeakTrackingVH> CurrentDef;
+  };
+
+  std::unordered_map<std::string, Variable> Vars;
+  llvm::SmallPtrSet<llvm::BasicBlock *, 32> Sealed;
+  llvm::DenseMap<llvm::BasicBlock *,
+                 std::vector<std::pair<Variable *, llvm::PHINode *>>>
+      IncompletePhis;
+
+public:
+  void declare(const std::string &Name, llvm::Type *Ty) { Vars[Name].Ty = Ty; }
+
+  bool contains(const std::string &Name) const { return Vars.count(Name); }
+
+  void write(const std::string &Name, llvm::BasicBlock *BB, llvm::Value *V);
+  llvm::Value *read(const std::string &Name, llvm::BasicBlock *BB);
+
+  // all predecessors of BB are emitted
+  void seal(llvm::BasicBlock *BB);
+
+  void clear();
+
+private:
+  llvm::Value *read(Variable &Var, llvm::BasicBlock *BB);
+  llvm::Value *readRecursive(Variable &Var, llvm::BasicBlock *BB);
+  llvm::Value *addPhiOperands(Variable &Var, llvm::PHINode *Phi);
+  llvm::Value *tryRemoveTrivialPhi(llvm::PHINode *Phi);
+  llvm::PHINode *createPhi(Variable &Var, llvm::BasicBlock *BB);
+};
+
+#endif // SSABUILDER_HPP
@@ -0,0 +1,98 @@
+#ifndef CONST_EVAL_H
+#define CONST_EVAL_H
+
+#include "../ASTNode/ExprCall.hpp"
+#include "../ASTNode/ExprNode.hpp"
+#include "../ASTNode/ItemFn.hpp"
+#include "../ASTNode/StmtNode.hpp"
+#include "../ASTNode/TypeNode.hpp"
+#include "Type.hpp"
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ConstValue {
+  enum Kind { Unit, Int, Bool, Aggregate };
+
+  Kind K = Unit;
+  long Value = 0; // Int and Bool
+  const QualType *Ty = nullptr; // of an Int, nullptr for a literal without one
+  std::vector<std::string> Fields; // struct field names, empty for arrays
+  std::vector<ConstValue> Elems;
+
+  static ConstValue makeInt(long V, Kind K = Int, const QualType *Ty = nullptr) {
+    ConstValue C;
+    C.K = K;
+    C.Value = V;
+    C.Ty = Ty;
+    return C;
+  }
+
+  bool isScalar() const { return K == Int || K == Bool; }
+};
+
+// Interpreter of const fn over the (not yet checked) AST.
+// Scalars, arrays and struct literals are supported inside the body,
+// the call itself must produce a scalar to become a const value.
+class ConstEval {
+public:
+  using ConstFns = std::unordered_map<std::string, ItemFn *>;
+  // value & type of a global const, false if unknown or not solved yet
+  using LookupConst = std::function<bool(std::string &, long &, const QualType *&)>;
+
+  static const long MaxSteps = 1000000;   // evaluated nodes per call tree
+  static const long MaxCells = 1000000;   // aggregate elements created per call tree
+  static const unsigned MaxDepth = 256;   // nested const fn calls
+
+private:
+  enum Flow { Normal, Break, Continue, Return };
+
+  struct NotConst {}; // unwinds out of a construct not evaluable at compile time
+
+  const ConstFns &Fns;
+  LookupConst Lookup;
+  std::vector<std::vector<std::unordered_map<std::string, ConstValue>>> Frames;
+  Flow Control = Normal;
+  ConstValue Carried; // value of break / return
+  long Steps = 0;
+  long Cells = 0;
+
+public:
+  ConstEval(const ConstFns &Fns, LookupConst Lookup)
+      : Fns(Fns), Lookup(std::move(Lookup)) {}
+
+  // evaluate a call of a const fn, false if it can not be evaluated
+  bool evalCall(ExprCall &N, ConstValue &Ret);
+
+  // names of global consts a call may read, through nested const fn calls too
+  static void collectFreeNames(const ConstFns &Fns, ExprCall &N,
+                               std::vector<std::string> &Names);
+
+private:
+  ConstValue call(ItemFn &Fn, std::vector<ConstValue> Args);
+  ConstValue eval(ExprNode &N);
+  void exec(StmtNode &N);
+  ConstValue *place(ExprNode &N); // nullptr if N does not name a local
+  ConstValue *lvalue(ExprNode &N);
+  ConstValue *findLocal(const std::string &Name);
+
+  ConstValue evalBinary(ExprNode &N);
+  ConstValue evalCallExpr(ExprCall &N);
+  ConstValue evalLoop(ExprNode *Cond, ExprNode &Body);
+
+  long wrap(const QualType *Ty, long V) const;
+  // A Op B at the width of Ty, throwing on overflow as rustc rejects it
+  long checked(const QualType *Ty, char Op, long A, long B) const;
+  const QualType *primitive(TypeNode *N) const;
+  // V as declared of type N: integers take the type and wrap to it, so do
+  // the elements of arrays
+  void settle(TypeNode *N, ConstValue &V) const;
+  ConstValue cast(TypeNode *N, ConstValue V) const;
+  ConstValue aggregate(std::vector<std::string> Fields, std::vector<ConstValue> Elems);
+  void tick();
+
+  struct NameCollector;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef CONST_SOLVER_H
 #define CONST_SOLVER_H
 
+#include "../ASTNode/ExprCall.hpp"
 #include "../ASTNode/ExprGrouped.hpp"
 #include "../ASTNode/ExprLiteral.hpp"
 #include "../ASTNode/ExprNode.hpp"
@@ -14,10 +15,13 @@
 #include "../ASTNode/StmtLet.hpp"
 #include "../ASTNode/TypeArray.hpp"
 #include "../ASTNode/TypePath.hpp"
+#include "ConstEval.hpp"
 #include "SymTable.hpp"
 #include "Type.hpp"
-#include <list>
+#include <algorithm>
+#include <deque>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class ConstSolver;
@@ -28,10 +32,10 @@ struct Result { // record <type, isConst, value>
   long value;
 
   Result(const QualType *Ty = QualType::getVoidType(), bool flag = false,
-         int value = 0) : Ty(Ty), flag(flag), value(value) {}
+         long value = 0) : Ty(Ty), flag(flag), value(value) {}
   const QualType *getTy() { return Ty; }
   bool isConst() { return flag; }
-  int getValue() { return value; }
+  long getValue() { return value; }
   bool empty() { return Ty == QualType::getVoidType() && flag; }
 };
 
@@ -40,34 +44,41 @@ class PrioriKnowledge { // record known const
 
 private:
   std::vector<ConstTable *> knowledge;
+  const ConstEval::ConstFns *fns = nullptr; // const fn callable at compile time
+  std::unordered_map<std::string, Result> memo; // tables do not change while solving
 
   bool count(std::string &Name) { return getValue(Name).empty(); }
 
   Result getValue(std::string &Name) {
+    auto found = memo.find(Name);
+    if (found != memo.end())
+      return found->second;
+    Result result;
     for (auto it = knowledge.rbegin(); it != knowledge.rend(); ++it) {
       auto table = *it;
-      if (table->count(Name))
-        return Result(table->getTy(Name), true, table->getValue(Name));
+      if (table->count(Name)) {
+        result = Result(table->getTy(Name), true, table->getValue(Name));
+        break;
+      }
     }
-    return Result();
+    return memo[Name] = result;
   }
 
 public:
-  void insert(ConstTable &table) { knowledge.push_back(&table); }
+  void insert(ConstTable &table) {
+    knowledge.push_back(&table);
+    memo.clear();
+  }
+
+  void insert(const ConstEval::ConstFns &constFns) { fns = &constFns; }
 };
 
 class Question { // record questions to solve
   friend ConstSolver;
 
 private:
-  std::list<ItemConst *> items;
-  std::list<ExprNode *> exprs;
-
-  bool empty() { return items.empty() && exprs.empty(); }
-
-  size_t itemLen() { return items.size(); }
-
-  size_t exprLen() { return items.size(); }
+  std::vector<ItemConst *> items;
+  std::vector<ExprNode *> exprs;
 
 public:
   void insert(ItemConst &item) { items.push_back(&item); }
@@ -131,6 +142,8 @@ public:
 
 private:
   bool Pass;
+  size_t Unsolved = 0; // questions without a const value
+  std::string Diagnostic;
 
   const QualType *getTy(TypeNode &N) {
     if (N.getTypeID() == ASTNode::K_TypePath) {
@@ -198,6 +211,7 @@ private:
     case ASTNode::K_ExprOpBinary:return checkExprOpBinary(*dynamic_cast<ExprOpBinary *>(&N));
     case ASTNode::K_ExprOpUnary:return checkExprOpUnary(*dynamic_cast<ExprOpUnary *>(&N));
     case ASTNode::K_ExprPath:return checkExprPath(*dynamic_cast<ExprPath *>(&N));
+    case ASTNode::K_ExprCall:return checkExprCall(*dynamic_cast<ExprCall *>(&N));
     }
   }
 
@@ -251,7 +265,33 @@ private:
     return getValue(path.identifier);
   }
 
-  long getBopValue(int left, int right, ExprOpBinaryType ty) {
+  Result checkExprCall(ExprCall &E) {
+    auto *callee = dynamic_cast<ExprPath *>(E.expr.get());
+    if (!prioriKnowledge.fns || !callee || callee->path2) {
+      return Result();
+    }
+    auto it = prioriKnowledge.fns->find(callee->path1->identifier);
+    if (it == prioriKnowledge.fns->end()) {
+      return Result();
+    }
+    ItemFn &fn = *it->second;
+    const QualType *Ty = fn.function_return_type ? getTy(*fn.function_return_type)
+                                                 : QualType::getVoidType();
+    ConstEval eval(*prioriKnowledge.fns, [this](std::string &name, long &value,
+                                                 const QualType *&ty) {
+      Result r = getValue(name);
+      value = r.getValue();
+      ty = r.getTy();
+      return r.isConst();
+    });
+    ConstValue ret;
+    if (!eval.evalCall(E, ret)) {
+      return Result();
+    }
+    return Result(Ty, true, ret.Value);
+  }
+
+  long getBopValue(long left, long right, ExprOpBinaryType ty) {
     switch (ty) {
     default:
       throw std::runtime_error("Invalid binary operator in const expr");
@@ -280,38 +320,114 @@ private:
     return false;
   }
 
+  // const names referenced by a const expr
+  void collectDeps(ExprNode &N, std::vector<std::string> &Deps) {
+    switch (N.getTypeID()) {
+    default:
+      return;
+    case ASTNode::K_ExprGrouped:
+      return collectDeps(*dynamic_cast<ExprGrouped *>(&N)->expr, Deps);
+    case ASTNode::K_ExprOpUnary:
+      return collectDeps(*dynamic_cast<ExprOpUnary *>(&N)->expr, Deps);
+    case ASTNode::K_ExprOpBinary: {
+      auto &E = *dynamic_cast<ExprOpBinary *>(&N);
+      collectDeps(*E.left, Deps);
+      return collectDeps(*E.right, Deps);
+    }
+    case ASTNode::K_ExprPath: {
+      auto &E = *dynamic_cast<ExprPath *>(&N);
+      if (!E.path2 && E.path1->type == PathType::Identifier)
+        Deps.push_back(E.path1->identifier);
+      return;
+    }
+    case ASTNode::K_ExprCall:
+      if (prioriKnowledge.fns)
+        ConstEval::collectFreeNames(*prioriKnowledge.fns, *dynamic_cast<ExprCall *>(&N), Deps);
+      return;
+    }
+  }
+
+  // evaluate every item once, after all the items it depends on
   void solveItem() {
-    bool Fixed = false;
     collectItem();
-    // fixed point
-    while (!Fixed) {
-      size_t len = question.itemLen();
-      for (auto it = question.items.begin(); it != question.items.end(); ) {
-        if (checkItem(*it)) {
-          it = question.items.erase(it); // checkItem 成功就移除
-        } else {
-          ++it;
+    auto &items = question.items;
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < items.size(); ++i) {
+      index[items[i]->identifier] = i;
+    }
+
+    // edges: dependency -> dependent item
+    std::vector<std::vector<size_t>> deps(items.size()), users(items.size());
+    std::vector<size_t> indegree(items.size(), 0);
+    for (size_t i = 0; i < items.size(); ++i) {
+      std::vector<std::string> names;
+      collectDeps(*items[i]->expr, names);
+      for (auto &name : names) {
+        auto it = index.find(name);
+        if (it == index.end())
+          continue; // prior knowledge or not a const
+        size_t d = it->second;
+        if (std::find(deps[i].begin(), deps[i].end(), d) != deps[i].end())
+          continue;
+        deps[i].push_back(d);
+        users[d].push_back(i);
+        ++indegree[i];
+      }
+    }
+
+    std::deque<size_t> ready;
+    for (size_t i = 0; i < items.size(); ++i) {
+      if (indegree[i] == 0)
+        ready.push_back(i);
+    }
+    size_t solved = 0;
+    while (!ready.empty()) {
+      size_t i = ready.front();
+      ready.pop_front();
+      ++solved;
+      if (!checkItem(items[i]))
+        ++Unsolved;
+      for (size_t u : users[i]) {
+        if (--indegree[u] == 0)
+          ready.push_back(u);
+      }
+    }
+    if (solved == items.size())
+      return;
+
+    // the rest are on a cycle or depend on one
+    Unsolved += items.size() - solved;
+    size_t cur = 0;
+    while (indegree[cur] == 0)
+      ++cur;
+    std::vector<size_t> path;
+    std::unordered_map<size_t, size_t> onPath; // item -> position in path
+    while (!onPath.count(cur)) {
+      onPath[cur] = path.size();
+      path.push_back(cur);
+      for (size_t d : deps[cur]) {
+        if (indegree[d] != 0) {
+          cur = d;
+          break;
         }
       }
-      Fixed = len == question.itemLen();
     }
+    Diagnostic = "cyclic const";
+    for (size_t p = onPath[cur]; p < path.size(); ++p) {
+      Diagnostic += (p == onPath[cur] ? ": " : " -> ") + items[path[p]]->identifier;
+    }
+    Diagnostic += " -> " + items[cur]->identifier + ".";
   }
 
   void solveExpr() {
-    bool Fixed = false;
-    // fixed point
-    while (!Fixed) {
-      size_t len = question.exprLen();
-      for (auto it = question.exprs.begin(); it != question.exprs.end(); ) {
-        Result result = checkExpr(**it);
-        if (result.isConst()) {
-          solution.insert(*it, result);
-          it = question.exprs.erase(it); // 求值成功就移除
-        } else {
-          ++it;
-        }
+    // exprs define no name, so one pass is enough
+    for (auto expr : question.exprs) {
+      Result result = checkExpr(*expr);
+      if (result.isConst()) {
+        solution.insert(expr, result);
+      } else {
+        ++Unsolved;
       }
-      Fixed = len == question.exprLen();
     }
   }
 
@@ -321,8 +437,11 @@ public:
   bool solve() {
     solveItem();
     solveExpr();
-    return Pass && question.empty();
+    return Pass && Unsolved == 0;
   }
+
+  // reason of the failure if known, e.g. a cycle between const items
+  const std::string &getDiagnostic() const { return Diagnostic; }
 };
 
 #endif
\ No newline at end of file
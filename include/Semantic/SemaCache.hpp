@@ -0,0 +1,64 @@
+#ifndef SEMACACHE_HPP
+#define SEMACACHE_HPP
+
+#include "../ASTNode/ItemFn.hpp"
+#include "../Lexer/token.hpp"
+#include "ConstEval.hpp"
+#include "SymTable.hpp"
+#include "Type.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// On-disk cache of the checked bodies of fn & method.
+// An entry is keyed by the fn name ("Struct::method" for methods) and is valid
+// while the fingerprint matches: a hash of the tokens of the item mixed with
+// the signatures of every global name those tokens mention.
+class SemaCache {
+public:
+  struct Entry {
+    std::uint64_t Hash = 0;
+    unsigned Base = 0;  // first local scope ID used by the body
+    unsigned Scopes = 0;// number of local scope IDs used by the body
+    std::vector<std::string> Records;// pre-order expr types, local names, lets
+  };
+
+private:
+  const std::vector<Token> &Tokens;
+  std::string Path;
+  std::unordered_map<std::string, Entry> Old; // loaded from Path
+  std::unordered_map<std::string, Entry> New; // written back to Path
+  std::unordered_map<std::string, std::uint64_t> SigIndex; // global name -> signature hash
+
+public:
+  SemaCache(const std::vector<Token> &Tokens, std::string Path)
+      : Tokens(Tokens), Path(std::move(Path)) {}
+
+  // a missing, stale or malformed file leaves the cache empty
+  void load();
+  void save() const;
+
+  // hash the signatures of all global names, call after signatures are collected;
+  // a const fn's also covers its body and those of the const fns it calls,
+  // since callers may have evaluated it
+  void indexSignatures(SymTable &Syms, const ConstEval::ConstFns &ConstFns);
+
+  std::uint64_t fingerprint(const ItemFn &N, const StructQualType *Self) const;
+
+  // return nullptr if there is no valid entry
+  const Entry *lookup(const std::string &Key, std::uint64_t Hash);
+
+  // restore expr types, local names and VarDecls of a checked body;
+  // return false and leave the body alone if the entry is stale or corrupted
+  bool replay(const Entry &E, ItemFn &N, SymTable &Syms);
+
+  // bodies with local const items are not recorded
+  void record(const std::string &Key, std::uint64_t Hash, ItemFn &N,
+              unsigned Base, unsigned Scopes);
+
+  static std::string encodeType(const QualType *Ty);
+  static const QualType *decodeType(const std::string &S, std::size_t &Pos, SymTable &Syms);
+};
+
+#endif // SEMACACHE_HPP
@@ -66,7 +66,11 @@ public:
     return true;
   }
 
-  const EnumQualType *getTy(std::string Name) { return Table[Name]; }
+  // a lookup only, codegen threads share the table
+  const EnumQualType *getTy(std::string Name) const {
+    auto It = Table.find(Name);
+    return It == Table.end() ? nullptr : It->second;
+  }
 };
 
 class TraitTable : public TableImpl<std::string, std::vector<std::pair<std::string, const FuncQualType *>>> {
@@ -121,12 +125,25 @@ class LocalScope {
   std::vector<ScopeTable> scopeStack;
 
   std::string genNewName(std::string Name, unsigned ID) {
-    return "_" + Name + "_" + std::to_string(ID);
+    return genName(Name, ID);
   }
 
 public:
   LocalScope() : scopeStack({}) {};
 
+  // scope IDs are global, the semantic cache replays a body by reserving its range
+  static unsigned peekID() { return Counter; }
+
+  static unsigned reserveIDs(unsigned N) {
+    unsigned Base = Counter;
+    Counter += N;
+    return Base;
+  }
+
+  static std::string genName(std::string Name, unsigned ID) {
+    return "_" + Name + "_" + std::to_string(ID);
+  }
+
   void enterScope() {
     ScopeTable curr = ScopeTable{Counter++};
     scopeStack.push_back(curr);
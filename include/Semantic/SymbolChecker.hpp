@@ -36,6 +36,8 @@
 #include "../ASTNode/TypePath.hpp"
 #include "../ASTNode/TypeReference.hpp"
 #include "../ASTNode/TypeUnit.hpp"
+#include "../Semantic/ConstEval.hpp"
+#include "../Semantic/SemaCache.hpp"
 #include "../Semantic/SymTable.hpp"
 #include "../Semantic/Type.hpp"
 #include <memory>
@@ -114,22 +116,38 @@ private:
   ItemFn *CurFunction = nullptr;// The function currently being processed
   bool islocal = false;// Is the current scope local
   LocalScope *scopes = nullptr;
+  SemaCache *Cache = nullptr;// reuse the bodies checked by a previous run
+
+  // global declarations bucketed by collectDecls, consumed by the later runs
+  std::vector<ItemFn *> Fns;
+  std::vector<ItemStruct *> Structs;
+  std::vector<ItemTrait *> Traits;
+  std::vector<ItemConst *> Consts;
+  std::vector<ItemImpl *> Impls; // one merged impl per struct
+  ConstEval::ConstFns ConstFns; // const fn that can be called at compile time
+  std::unordered_map<std::pair<std::string, std::string>, size_t, PairHash>
+      TraitImplSize; // (trait, struct) -> number of implemented items
 
 public:
   Checker(std::shared_ptr<Crate> &Prog, SymTable &Syms);
 
   void check();
 
+  void setCache(SemaCache *C) { Cache = C; }
+
+  // local a place expression is rooted at, nullptr if it has none
+  static const ExprPath *getPlaceRoot(const ExprNode &N);
+
 private:
-  void initRun();// move nested items (except const) to global
-  void firstRun();// collect define of data struct (struct, const, enum, trait)
-  void secondRun();// calculate the value of const items in global
-  void thirdRun();// collect field of struct & signature of fn
-  void forthRun();// check impl trait of struct & trait
-  void fifthRun();// check each fn & impl in detail
+  void collectDecls();// declare struct, enum, trait, const; hoist nested items and merge impls
+  void solveConsts();// calculate the value of const items in global
+  void collectSignatures();// collect field of struct, signature of fn & method, check impl trait
+  void checkBodies();// check each fn & impl in detail
 
 private:
-  void removeItem(std::unordered_set<ItemNode *> &remove);
+  void hoistNestedItems(ItemFn &N);
+  void mergeImpl(ItemImpl &N, std::unordered_map<std::string, ItemImpl *> &Merged);
+  void removeItem();
   // specific the type of self
   // self of trait has no exact type
   const FuncQualType *setFnSignature(ItemFn &N, bool isImp);
@@ -148,6 +166,8 @@ private:
 
   const QualType *checkPath(Path &N);
 
+  void checkCachedItemFn(ItemFn &N);
+  void declareParams(ItemFn &N);
   void checkItemFn(ItemFn &N);
   // void checkItemStruct(ItemStruct &N);
   void checkItemEnum(ItemEnum &N);
@@ -196,6 +216,9 @@ private:
   const QualType *getUnitType(TypeUnit &N);
 
   long evaluateExprNode(ExprNode &N);
+  // give integer literals inside N the type Ty its context expects, so
+  // codegen knows their width & signedness
+  void settleType(ExprNode &N, const QualType *Ty);
 };
 
 #endif // SYMBOLCHECKER_HPP
\ No newline at end of file
@@ -68,6 +68,9 @@ public:
   static QualType *getCharType() { return &I_char; }
   static QualType *getStringType() { return &I_string; }
 
+  // i32, u32, usize, isize, bool, char, str and String; nullptr for other names
+  static const QualType *getPrimitiveType(const std::string &Name);
+
   bool isI32() const { return TypeID == T_i32; }
   bool isU32() const { return TypeID == T_u32; }
   bool isIsize() const { return TypeID == T_isize; }
@@ -82,6 +85,14 @@ public:
   bool isArray() const { return TypeID == T_array; }
   bool isFunc() const { return TypeID == T_func; }
   bool isIntLiteral() const { return TypeID == T_intLiteral; }
+  // i32, u32, isize & usize, a literal has no type of its own yet
+  bool isInteger() const {
+    return TypeID == T_i32 || TypeID == T_u32 || TypeID == T_isize || TypeID == T_usize;
+  }
+  // divided, compared & widened as unsigned
+  bool isUnsigned() const {
+    return TypeID == T_u32 || TypeID == T_usize || TypeID == T_bool || TypeID == T_char;
+  }
 };
 
 using MutQualType = std::pair<bool, const QualType*>; //（是否可变，类型指针）
@@ -310,6 +321,8 @@ public:
     return Instances[Name] = new EnumQualType(Name, Fields);
   }
 
+  const std::string &getName() const { return Name; }
+
   const std::vector<std::string> &getFields() const { return Fields; }
 
   size_t indexOf(std::string Name) const {
@@ -345,11 +358,13 @@ public:
     default:
       return false;
     case T_i32:
-    case T_isize:
       return Num >= INT32_MIN && Num <= INT32_MAX;
     case T_u32:
-    case T_usize:
       return Num >= 0 && Num <= UINT32_MAX;
+    case T_isize:
+      return true;
+    case T_usize:
+      return Num >= 0;
     case T_intLiteral:
       return true;
     }
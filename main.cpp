@@ -1,18 +1,93 @@
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 #include "include/Lexer/lexer.hpp"
 #include "include/Parser/parser.hpp"
+#include "include/Semantic/SemaCache.hpp"
 #include "include/Semantic/SymbolChecker.hpp"
 #include "include/CodeGen/CodeGen.hpp"
+#include "include/CodeGen/Emitter.hpp"
+#include "include/CodeGen/JITRunner.hpp"
+#include "include/CodeGen/Optimizer.hpp"
 
-int main() {
+int main(int argc, char **argv) {
   try {
+    std::string cachePath;
+    int optLevel = -1; // no pipeline unless -O<n> is given
+    bool timePasses = false;
+    Emitter::Kind emitKind = Emitter::IR;
+    std::string outPath;
+    std::string runtimePath;
+    std::string inputPath; // stdin if empty
+    bool run = false;
+    bool wholeProgram = false;
+    bool boundsChecks = false;
+    bool reorderFields = false;
+    bool vectorizeLoops = false;
+    bool unrollLoops = false;
+    unsigned threads = 1;
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if (arg.rfind("--sema-cache=", 0) == 0) {
+        cachePath = arg.substr(13);
+      } else if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' &&
+                 arg[2] >= '0' && arg[2] <= '3') {
+        optLevel = arg[2] - '0';
+      } else if (arg == "--time-passes") {
+        timePasses = true;
+      } else if (arg.rfind("--emit=", 0) == 0) {
+        emitKind = Emitter::parseKind(arg.substr(7));
+      } else if (arg == "-o" && i + 1 < argc) {
+        outPath = argv[++i];
+      } else if (arg.rfind("--runtime=", 0) == 0) {
+        runtimePath = arg.substr(10);
+      } else if (arg == "--run") {
+        run = true;
+      } else if (arg == "--whole-program") {
+        wholeProgram = true;
+      } else if (arg == "--bounds-checks") {
+        boundsChecks = true;
+      } else if (arg == "--reorder-fields") {
+        reorderFields = true;
+      } else if (arg == "--vectorize-loops") {
+        vectorizeLoops = true;
+      } else if (arg == "--unroll-loops") {
+        unrollLoops = true;
+      } else if (arg.rfind("--threads=", 0) == 0) {
+        std::string n = arg.substr(10);
+        if (n.empty() || n.size() > 4 || n.find_first_not_of("0123456789") != std::string::npos) {
+          throw std::runtime_error("invalid thread count " + n);
+        }
+        // 0: one per hardware thread
+        threads = std::stoi(n) ? std::stoi(n) : std::max(1u, std::thread::hardware_concurrency());
+      } else if (!arg.empty() && arg[0] != '-' && inputPath.empty()) {
+        inputPath = arg;
+      } else {
+        throw std::runtime_error("unknown option " + arg);
+      }
+    }
+
+    if (run && inputPath.empty()) {
+      // stdin belongs to the program being run
+      throw std::runtime_error("--run needs the source file as an argument");
+    }
+    std::ifstream file;
+    if (!inputPath.empty()) {
+      file.open(inputPath);
+      if (!file) {
+        throw std::runtime_error("cannot open " + inputPath);
+      }
+    }
+    std::istream &input = inputPath.empty() ? std::cin : file;
+
     std::string src;
     std::string line;
     while (true) {
-      if (!getline(std::cin, line)) {
+      if (!getline(input, line)) {
         break;
       }
       src += line;
@@ -28,15 +103,58 @@ int main() {
 
     SymTable Syms;
     Checker Checker(crate, Syms);
+    SemaCache cache(tokens, cachePath);
+    if (!cachePath.empty()) {
+      cache.load();
+      Checker.setCache(&cache);
+    }
     Checker.check();
+    if (!cachePath.empty()) {
+      // only a successful check is worth keeping
+      cache.save();
+    }
     //std::cout << "Checker succeeded." << std::endl;
 
-    llvm::LLVMContext context;
-    llvm::Module module("R-Module", context);
-    CodeGen codegen(*crate, Syms, context, module);
+    auto context = std::make_unique<llvm::LLVMContext>();
+    auto module = std::make_unique<llvm::Module>("R-Module", *context);
+    Emitter emitter(*module);
+    if (run || (emitKind != Emitter::IR && emitKind != Emitter::BC)) {
+      // codegen & the optimizer should see the target's data layout
+      emitter.initTarget();
+    }
+    CodeGen codegen(*crate, Syms, *context, *module);
+    codegen.setWholeProgram(wholeProgram);
+    codegen.setBoundsChecks(boundsChecks);
+    codegen.setReorderFields(reorderFields);
+    codegen.setVectorizeLoops(vectorizeLoops);
+    codegen.setUnrollLoops(unrollLoops);
+    codegen.setThreads(threads);
     bool success = codegen.emit();
     if (success) {
-      module.print(llvm::outs(), nullptr);
+      if (boundsChecks) {
+        codegen.reportBoundsChecks(std::cerr);
+      }
+      // objects are optimized & lowered per partition, one thread each
+      bool split = threads > 1 && !run && !timePasses &&
+                   (emitKind == Emitter::Obj || emitKind == Emitter::Exe);
+      if (split) {
+        emitter.writeSplit(emitKind, outPath, runtimePath, threads,
+                           [&](llvm::Module &part, llvm::TargetMachine *machine) {
+                             if (optLevel >= 0) {
+                               Optimizer(optLevel, false, boundsChecks).run(part, machine);
+                             }
+                           });
+        return 0;
+      }
+      if (optLevel >= 0 || timePasses) {
+        Optimizer optimizer(optLevel < 0 ? 0 : optLevel, timePasses, boundsChecks);
+        optimizer.run(*module, emitter.getTargetMachine());
+      }
+      if (run) {
+        JITRunner runner(std::move(context), std::move(module));
+        return runner.run(runtimePath);
+      }
+      emitter.write(emitKind, outPath, runtimePath);
       //std::cout << "Code generation succeeded." << std::endl;
     } else {
       throw std::runtime_error("Code generation failed.");
@@ -9,14 +9,33 @@
 #include "../../include/ASTNode/ItemStruct.hpp"
 #include "../../include/ASTNode/Path.hpp"
 #include "../../include/Semantic/Type.hpp"
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <exception>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/CFG.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IR/Verifier.h>
-#include <queue>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/raw_ostream.h>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -26,7 +45,24 @@ CodeGen::CodeGen(const Crate &Prog, const SymTable &Syms,
       Builder(Context) {}
 
 bool CodeGen::emit() {
-  emitCrate(Prog);
+  if (Threads > 1) {
+    emitParallel();
+  } else {
+    emitCrate(Prog);
+    // before pruning, which may delete functions BoundsFailBB refers to
+    eliminateBoundsChecks();
+  }
+
+  // a whole program: nothing but main is called from outside
+  for (llvm::Function &F : Module) {
+    if (!F.isDeclaration() && F.getName() != "main") {
+      F.setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+  }
+  if (WholeProgram) {
+    removeUnreachableFns();
+  }
+  inferFnAttrs();
 
   if (llvm::verifyModule(Module, &llvm::errs())) {
     throw std::runtime_error("module verification failed");
@@ -38,41 +74,291 @@ void CodeGen::emitCrate(const Crate &N) {
   emitStructDefination();
   emitFunctionDefination();
 
-  for (auto &Item : N.children) {
-    emitItemNode(*Item);
+  for (size_t I = 0; I < N.children.size(); ++I) {
+    if (ItemPartition && (*ItemPartition)[I] != Partition) {
+      continue; // another partition's, the declaration is enough here
+    }
+    emitItemNode(*N.children[I]);
   }
 }
 
-void CodeGen::emitStructDefination() {
-  std::queue<std::pair<std::string, StructQualType *>> q;
-  for (auto It : Syms.structTable.getTable()) {
-    q.push(It);
-  }
-
-  for (unsigned i = 0; i < 5; i++) {
-    int len = q.size();
-    for (int i = 0; i < len; i++) {
-      auto [Name, Ty] = q.front();
-      q.pop();
-
-      bool canCreate = true;
-      std::vector<llvm::Type*> Types;
-      for (auto &F : Ty->getFields()) {
-        llvm::Type *FieldTy = convertType(F.Type);
-        if (!FieldTy) {
-          canCreate = false;
-          break;
+// a rough measure of the code an item expands to
+static size_t getItemSize(const ItemNode &N) {
+  switch (N.getTypeID()) {
+  default:
+    return 0;
+  case ASTNode::K_ItemFn: {
+    const ItemFn &Fn = static_cast<const ItemFn &>(N);
+    return Fn.block_expr ? Fn.block_expr->stmts.size() + 1 : 0;
+  }
+  case ASTNode::K_ItemImpl: {
+    size_t Size = 0;
+    for (auto &I : static_cast<const ItemImpl &>(N).associated_items) {
+      Size += getItemSize(*I);
+    }
+    return Size;
+  }
+  }
+}
+
+std::vector<unsigned> CodeGen::partitionItems() const {
+  const auto &Items = Prog.children;
+  std::vector<size_t> Order(Items.size());
+  for (size_t I = 0; I < Order.size(); ++I) {
+    Order[I] = I;
+  }
+  // largest first, each to the partition with the least so far
+  std::stable_sort(Order.begin(), Order.end(), [&](size_t A, size_t B) {
+    return getItemSize(*Items[A]) > getItemSize(*Items[B]);
+  });
+  std::vector<unsigned> ItemPartition(Items.size());
+  std::vector<size_t> Load(Threads);
+  for (size_t I : Order) {
+    unsigned Least = std::min_element(Load.begin(), Load.end()) - Load.begin();
+    ItemPartition[I] = Least;
+    Load[Least] += getItemSize(*Items[I]);
+  }
+  return ItemPartition;
+}
+
+void CodeGen::emitParallel() {
+  std::vector<unsigned> ItemPartition = partitionItems();
+  std::vector<llvm::SmallVector<char, 0>> Bitcode(Threads);
+  std::vector<std::exception_ptr> Errors(Threads);
+  std::mutex StatsMutex;
+
+  // the AST & symbol tables are only read, each thread owns its context
+  std::vector<std::thread> Workers;
+  for (unsigned I = 0; I < Threads; ++I) {
+    Workers.emplace_back([&, I] {
+      try {
+        llvm::LLVMContext PartContext;
+        llvm::Module PartModule(Module.getModuleIdentifier(), PartContext);
+        PartModule.setTargetTriple(Module.getTargetTriple());
+        PartModule.setDataLayout(Module.getDataLayout());
+
+        CodeGen Part(Prog, Syms, PartContext, PartModule);
+        Part.ReorderFields = ReorderFields;
+        Part.BoundsChecks = BoundsChecks;
+        Part.VectorizeLoops = VectorizeLoops;
+        Part.UnrollLoops = UnrollLoops;
+        Part.ItemPartition = &ItemPartition;
+        Part.Partition = I;
+        Part.emitCrate(Prog);
+        Part.eliminateBoundsChecks();
+        {
+          std::lock_guard<std::mutex> Lock(StatsMutex);
+          NumBoundsChecks += Part.NumBoundsChecks;
+          NumBoundsChecksFolded += Part.NumBoundsChecksFolded;
+          NumBoundsChecksRemoved += Part.NumBoundsChecksRemoved;
         }
-        Types.emplace_back(FieldTy);
+
+        llvm::raw_svector_ostream OS(Bitcode[I]);
+        llvm::WriteBitcodeToFile(PartModule, OS);
+      } catch (...) {
+        Errors[I] = std::current_exception();
       }
-      if (canCreate) {
-        StructTyDef[Name] = llvm::StructType::create(Context, Types, Name);
-      } else {
-        q.push({Name, Ty});
+    });
+  }
+  for (std::thread &T : Workers) {
+    T.join();
+  }
+  for (std::exception_ptr &E : Errors) {
+    if (E) {
+      std::rethrow_exception(E);
+    }
+  }
+
+  // in partition order, the result does not depend on scheduling
+  llvm::Linker L(Module);
+  for (unsigned I = 0; I < Threads; ++I) {
+    llvm::MemoryBufferRef Buffer(llvm::StringRef(Bitcode[I].data(), Bitcode[I].size()),
+                                 "partition" + std::to_string(I));
+    llvm::Expected<std::unique_ptr<llvm::Module>> Part =
+        llvm::parseBitcodeFile(Buffer, Context);
+    if (!Part) {
+      throw std::runtime_error("cannot read partition " + std::to_string(I) + ": " +
+                               llvm::toString(Part.takeError()));
+    }
+    if (L.linkInModule(std::move(*Part))) {
+      throw std::runtime_error("cannot link partition " + std::to_string(I));
+    }
+  }
+}
+
+// the struct Ty holds by value, looking through arrays; nullptr if none
+static const StructQualType *getHeldStruct(const QualType *Ty) {
+  while (const ArrayQualType *A = dynamic_cast<const ArrayQualType *>(Ty)) {
+    Ty = A->getElemType();
+  }
+  return dynamic_cast<const StructQualType *>(Ty);
+}
+
+// N without the parentheses around it
+static const ExprNode *stripGrouped(const ExprNode *N) {
+  while (auto *G = dynamic_cast<const ExprGrouped *>(N)) {
+    N = G->expr.get();
+  }
+  return N;
+}
+
+// the calls whose value is the function's result: tails of blocks & if arms
+// in tail position, returned expressions, and the last statement of a block
+// in tail position when the function returns nothing
+static void collectTailCalls(const ExprNode *N, bool Tail, bool Void,
+                             std::unordered_set<const ExprNode *> &Calls) {
+  N = stripGrouped(N);
+  switch (N->getTypeID()) {
+  default:
+    break;
+  case ASTNode::K_ExprCall:
+  case ASTNode::K_ExprMethodCall:
+    if (Tail) {
+      Calls.insert(N);
+    }
+    break;
+  case ASTNode::K_ExprReturn: {
+    const ExprReturn *R = static_cast<const ExprReturn *>(N);
+    if (R->expr) {
+      collectTailCalls(R->expr.get(), true, Void, Calls);
+    }
+    break;
+  }
+  case ASTNode::K_ExprBlock: {
+    const ExprBlock *B = static_cast<const ExprBlock *>(N);
+    for (size_t Idx = 0; Idx < B->stmts.size(); Idx++) {
+      if (B->stmts[Idx]->getTypeID() != ASTNode::K_StmtExpr) {
+        continue;
       }
+      bool Last = Tail && Void && !B->expr && Idx + 1 == B->stmts.size();
+      collectTailCalls(static_cast<const StmtExpr *>(B->stmts[Idx].get())->expr.get(),
+                       Last, Void, Calls);
     }
+    if (B->expr) {
+      collectTailCalls(B->expr.get(), Tail, Void, Calls);
+    }
+    break;
+  }
+  case ASTNode::K_ExprIf: {
+    const ExprIf *I = static_cast<const ExprIf *>(N);
+    collectTailCalls(I->if_block.get(), Tail, Void, Calls);
+    if (I->else_block) {
+      collectTailCalls(I->else_block.get(), Tail, Void, Calls);
+    }
+    break;
+  }
+  case ASTNode::K_ExprLoopInfinite:
+    collectTailCalls(static_cast<const ExprLoopInfinite *>(N)->block.get(), false, Void, Calls);
+    break;
+  case ASTNode::K_ExprLoopPredicate:
+    collectTailCalls(static_cast<const ExprLoopPredicate *>(N)->block.get(), false, Void, Calls);
+    break;
   }
-  assert(q.empty() && "failed to create struct defination");
+}
+
+void CodeGen::emitStructDefination() {
+  // named and bodiless first, a pointer field may refer to any struct
+  for (auto [Name, Ty] : Syms.structTable.getTable()) {
+    StructTyDef[Name] = llvm::StructType::create(Context, Name);
+  }
+  std::unordered_set<std::string> Escaping;
+  if (ReorderFields) {
+    Escaping = collectEscapingStructs();
+  }
+  // bodies in dependency order, each one after the structs it holds
+  std::unordered_map<std::string, bool> Done; // false while being laid out
+  for (auto [Name, Ty] : Syms.structTable.getTable()) {
+    emitStructBody(Ty, Done, Escaping);
+  }
+}
+
+void CodeGen::emitStructBody(const StructQualType *Ty,
+                             std::unordered_map<std::string, bool> &Done,
+                             const std::unordered_set<std::string> &Escaping) {
+  const std::string &Name = Ty->getName();
+  auto [It, Inserted] = Done.emplace(Name, false);
+  if (!Inserted) {
+    if (!It->second) {
+      throw std::runtime_error("struct " + Name + " contains itself");
+    }
+    return;
+  }
+
+  std::vector<llvm::Type *> Types;
+  for (auto &F : Ty->getFields()) {
+    if (const StructQualType *Held = getHeldStruct(F.Type)) {
+      emitStructBody(Held, Done, Escaping);
+    }
+    Types.push_back(convertType(F.Type));
+  }
+
+  if (ReorderFields && !Escaping.count(Name)) {
+    // decreasing alignment leaves padding only at the end
+    const llvm::DataLayout &DL = Module.getDataLayout();
+    std::vector<unsigned> Order(Types.size());
+    for (unsigned I = 0; I < Order.size(); ++I) {
+      Order[I] = I;
+    }
+    std::stable_sort(Order.begin(), Order.end(), [&](unsigned A, unsigned B) {
+      return DL.getABITypeAlign(Types[A]) > DL.getABITypeAlign(Types[B]);
+    });
+    std::vector<unsigned> &Slots = FieldSlots[Name];
+    Slots.resize(Order.size());
+    std::vector<llvm::Type *> Sorted;
+    for (unsigned I = 0; I < Order.size(); ++I) {
+      Slots[Order[I]] = I;
+      Sorted.push_back(Types[Order[I]]);
+    }
+    Types = std::move(Sorted);
+  }
+  StructTyDef[Name]->setBody(Types);
+  It->second = true;
+}
+
+std::unordered_set<std::string> CodeGen::collectEscapingStructs() {
+  std::unordered_set<std::string> Defined;
+  for (auto &Item : Prog.children) {
+    if (Item->getTypeID() == ASTNode::K_ItemFn) {
+      auto &Fn = static_cast<const ItemFn &>(*Item);
+      if (Fn.block_expr) {
+        Defined.insert(Fn.identifier);
+      }
+    }
+  }
+
+  // main and the runtime's functions keep their external signatures
+  std::vector<const QualType *> Work;
+  for (auto [Name, FnTy] : Syms.fnTable.getTable()) {
+    if (Name == "main" || !Defined.count(Name)) {
+      Work.push_back(FnTy->getReturnType());
+      for (auto Ty : FnTy->getParamTypes()) {
+        Work.push_back(Ty);
+      }
+    }
+  }
+  std::unordered_set<std::string> Escaping;
+  while (!Work.empty()) {
+    const QualType *Ty = Work.back();
+    Work.pop_back();
+    if (auto *P = dynamic_cast<const PointerQualType *>(Ty)) {
+      Work.push_back(P->getElemType());
+    } else if (auto *A = dynamic_cast<const ArrayQualType *>(Ty)) {
+      Work.push_back(A->getElemType());
+    } else if (auto *S = dynamic_cast<const StructQualType *>(Ty)) {
+      if (Escaping.insert(S->getName()).second) {
+        for (auto &F : S->getFields()) {
+          Work.push_back(F.Type);
+        }
+      }
+    }
+  }
+  return Escaping;
+}
+
+unsigned CodeGen::getFieldSlot(const StructQualType *Ty, const std::string &Field) {
+  unsigned Idx = Ty->getFieldIndex(Field);
+  auto It = FieldSlots.find(Ty->getName());
+  return It == FieldSlots.end() ? Idx : It->second[Idx];
 }
 
 std::string CodeGen::mangleFnName(std::string StructName, std::string FnName) {
@@ -91,19 +377,25 @@ void CodeGen::emitFunctionDefination() {
   for (auto [Name, FnTy] : Syms.fnTable.getTable()) {
     std::vector<llvm::Type *> ParamTypes;
     for (auto Ty : FnTy->getParamTypes()) {
-      ParamTypes.push_back(convertType(Ty));
+      ParamTypes.push_back(convertParamType(Ty));
     }
 
     llvm::Type *RetType;
     if (FnTy->getReturnType()->isStruct() || FnTy->getReturnType()->isArray()) {
       RetType = llvm::Type::getVoidTy(Context);
-      ParamTypes.push_back(llvm::PointerType::get(Context, 0));
+      // the result pointer comes first, where sret is allowed
+      ParamTypes.insert(ParamTypes.begin(), llvm::PointerType::get(Context, 0));
     } else {
       RetType = convertType(FnTy->getReturnType());
     }
     
     llvm::FunctionType *FTy = llvm::FunctionType::get(RetType, ParamTypes, false);
-    llvm::Function::Create(FTy, llvm::Function::ExternalLinkage, Name, Module);
+    llvm::Function *Fn =
+        llvm::Function::Create(FTy, llvm::Function::ExternalLinkage, Name, Module);
+    addFnAttrs(Fn, FnTy);
+    if (Name == "exit") {
+      Fn->setDoesNotReturn();
+    }
   }
 
 
@@ -114,24 +406,26 @@ void CodeGen::emitFunctionDefination() {
       
       std::vector<llvm::Type *> ParamTypes;
       for (auto Ty : FnTy->getParamTypes())
-        ParamTypes.push_back(convertType(Ty));
+        ParamTypes.push_back(convertParamType(Ty));
 
       llvm::Type *RetType;
       if (FnTy->getReturnType()->isStruct() || FnTy->getReturnType()->isArray()) {
         RetType = llvm::Type::getVoidTy(Context);
-        ParamTypes.push_back(llvm::PointerType::get(Context, 0));
+        ParamTypes.insert(ParamTypes.begin(), llvm::PointerType::get(Context, 0));
       } else {
         RetType = convertType(FnTy->getReturnType());
       }
       
       llvm::FunctionType *FTy = llvm::FunctionType::get(RetType, ParamTypes, false);
-      llvm::Function::Create(FTy, llvm::Function::ExternalLinkage, MangledName, Module);
+      llvm::Function *Fn = llvm::Function::Create(
+          FTy, llvm::Function::ExternalLinkage, MangledName, Module);
+      addFnAttrs(Fn, FnTy);
     }
   }
 }
 
 llvm::Value *CodeGen::getDerefValue(llvm::Value *Val, const QualType *Ty) {
-  if (Val == nullptr || !Val->getType()->isPointerTy()) {
+  if (Val == nullptr || !Val->getType()->isPointerTy() || isStringLiteral(Val)) {
     return Val;
   }
 
@@ -155,23 +449,501 @@ llvm::AllocaInst *CodeGen::createAlloca(llvm::Type *Ty, llvm::Value *ArraySize,
   llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
   llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
                    TheFunction->getEntryBlock().begin());
-  return TmpB.CreateAlloca(Ty, ArraySize, Name);
+  llvm::AllocaInst *Alloca = TmpB.CreateAlloca(Ty, ArraySize, Name);
+  // live from here to the end of the innermost scope, so slots of disjoint
+  // scopes can share stack space
+  if (!LiveSlots.empty() && !ArraySize && !Builder.GetInsertBlock()->getTerminator()) {
+    Builder.CreateLifetimeStart(
+        Alloca, Builder.getInt64(Module.getDataLayout().getTypeAllocSize(Ty)));
+    LiveSlots.back().push_back(Alloca);
+  }
+  return Alloca;
 }
 
-void CodeGen::createMemCpy(llvm::Value *Dest, llvm::Value *Src, llvm::Type *Ty) {
-  llvm::DataLayout DL = Module.getDataLayout();
-  llvm::Function *Fn = Module.getFunction("memcpy");
-  if (!Fn) {
-    llvm::Type *PtrTy = llvm::PointerType::getUnqual(Context);
-    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(Context);
-    llvm::FunctionType *FTy = llvm::FunctionType::get(PtrTy, {PtrTy, PtrTy, Int32Ty}, false);
-    Fn = llvm::Function::Create(FTy, llvm::Function::ExternalLinkage, "memcpy", Module);
+// the llvm.lifetime.start of Slot, nullptr if it is live throughout
+static llvm::IntrinsicInst *getLifetimeStart(llvm::AllocaInst *Slot) {
+  for (llvm::User *U : Slot->users()) {
+    auto *II = llvm::dyn_cast<llvm::IntrinsicInst>(U);
+    if (II && II->getIntrinsicID() == llvm::Intrinsic::lifetime_start) {
+      return II;
+    }
+  }
+  return nullptr;
+}
+
+void CodeGen::popLifetimeScope(bool Escaping) {
+  std::vector<llvm::AllocaInst *> Slots = std::move(LiveSlots.back());
+  LiveSlots.pop_back();
+  if (Escaping) {
+    if (!LiveSlots.empty()) {
+      LiveSlots.back().insert(LiveSlots.back().end(), Slots.begin(), Slots.end());
+    }
+    return;
+  }
+  // left by return, break or continue: the slots stay live, conservatively
+  if (Builder.GetInsertBlock()->getTerminator()) {
+    return;
+  }
+  for (auto It = Slots.rbegin(); It != Slots.rend(); ++It) {
+    if (getLifetimeStart(*It)) {
+      Builder.CreateLifetimeEnd(
+          *It, Builder.getInt64(
+                   Module.getDataLayout().getTypeAllocSize((*It)->getAllocatedType())));
+    }
+  }
+}
+
+void CodeGen::pinLifetime(llvm::Value *Slot) {
+  auto *Alloca = llvm::dyn_cast<llvm::AllocaInst>(Slot);
+  if (!Alloca) {
+    return;
+  }
+  for (auto &Scope : LiveSlots) {
+    auto It = std::find(Scope.begin(), Scope.end(), Alloca);
+    if (It != Scope.end()) {
+      Scope.erase(It);
+      getLifetimeStart(Alloca)->eraseFromParent();
+      return;
+    }
+  }
+}
+
+bool CodeGen::isSSALocal(const std::string &Name, llvm::Type *Ty) const {
+  // a borrowed local needs an address, and only integers are values that
+  // getValue never mistakes for an address
+  return Ty->isIntegerTy() && CurrentFn->containVarDecl(Name) &&
+         !CurrentFn->getVarDecl(Name).addrTaken;
+}
+
+std::string CodeGen::getSSAPlace(const ExprNode &N) const {
+  if (const ExprGrouped *G = dynamic_cast<const ExprGrouped*>(&N)) {
+    return getSSAPlace(*G->expr);
+  }
+  const ExprPath *P = dynamic_cast<const ExprPath*>(&N);
+  if (P && !P->path2 && P->path1->type == PathType::Identifier &&
+      SSA.contains(P->path1->identifier)) {
+    return P->path1->identifier;
+  }
+  return "";
+}
+
+llvm::Value *CodeGen::castInt(llvm::Value *V, const QualType *From, llvm::Type *To) {
+  if (!V || !To || V->getType() == To || !V->getType()->isIntegerTy() ||
+      !To->isIntegerTy()) {
+    return V;
+  }
+  return Builder.CreateIntCast(V, To, !From->isUnsigned());
+}
+
+llvm::Value *CodeGen::createMergePhi(
+    llvm::Type *Ty, const std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> &Incoming,
+    const llvm::Twine &Name) {
+  if (Incoming.empty()) {
+    return llvm::PoisonValue::get(Ty); // nothing flows here
+  }
+  llvm::PHINode *PN = Builder.CreatePHI(Ty, Incoming.size(), Name);
+  for (auto [V, BB] : Incoming) {
+    if (V->getType() != Ty) {
+      // an unsettled literal, widened where it flows out of BB
+      V = llvm::CastInst::CreateIntegerCast(V, Ty, true, "", BB->getTerminator());
+    }
+    PN->addIncoming(V, BB);
   }
+  return PN;
+}
+
+void CodeGen::createMemCpy(llvm::Value *Dest, llvm::Value *Src, llvm::Type *Ty) {
+  const llvm::DataLayout &DL = Module.getDataLayout();
   uint64_t SizeInBytes = DL.getTypeAllocSize(Ty);
+  llvm::Align Alignment = DL.getABITypeAlign(Ty);
+
+  // small aggregates as a typed load/store, which SROA splits into scalars
+  if (SizeInBytes <= MaxInlineCopySize) {
+    Builder.CreateAlignedStore(Builder.CreateAlignedLoad(Ty, Src, Alignment),
+                               Dest, Alignment);
+    return;
+  }
+  Builder.CreateMemCpy(Dest, Alignment, Src, Alignment, Builder.getInt64(SizeInBytes));
+}
+
+void CodeGen::emitExprInto(const ExprNode &N, llvm::Value *Dest) {
+  InPlaceExpr = &N;
+  InPlaceAddr = Dest;
+  llvm::Value *V = emitExprNode(N);
+  InPlaceExpr = nullptr;
+  InPlaceAddr = nullptr;
+  if (V && V != Dest) {
+    createMemCpy(Dest, V, convertType(N.getQualType()));
+  }
+}
+
+llvm::Value *CodeGen::takeInPlaceAddr(const ExprNode &N) {
+  // only the expression it was meant for, never one nested inside it
+  if (InPlaceExpr != &N) {
+    return nullptr;
+  }
+  llvm::Value *Dest = InPlaceAddr;
+  InPlaceExpr = nullptr;
+  InPlaceAddr = nullptr;
+  return Dest;
+}
+
+void CodeGen::addFnAttrs(llvm::Function *Fn, const FuncQualType *FnTy) {
+  // there is no unwinding, neither here nor in the runtime
+  Fn->setDoesNotThrow();
+
+  unsigned ArgBase = 0;
+  const QualType *RetTy = FnTy->getReturnType();
+  if (RetTy->isStruct() || RetTy->isArray()) {
+    Fn->addParamAttr(0, llvm::Attribute::getWithStructRetType(Context, convertType(RetTy)));
+    Fn->addParamAttr(0, llvm::Attribute::NoAlias);
+    ArgBase = 1;
+  }
+
+  const llvm::DataLayout &DL = Module.getDataLayout();
+  const std::vector<const QualType *> &ParamTys = FnTy->getParamTypes();
+  for (size_t Idx = 0; Idx < ParamTys.size(); Idx++) {
+    unsigned ArgNo = ArgBase + Idx;
+    if (isIndirectParam(ParamTys[Idx])) {
+      // the caller's private copy, which the callee may also modify
+      llvm::Type *Ty = convertType(ParamTys[Idx]);
+      Fn->addParamAttr(ArgNo, llvm::Attribute::NonNull);
+      Fn->addParamAttr(ArgNo, llvm::Attribute::NoUndef);
+      Fn->addParamAttr(ArgNo, llvm::Attribute::NoAlias);
+      Fn->addDereferenceableParamAttr(ArgNo, DL.getTypeAllocSize(Ty));
+      Fn->addParamAttr(ArgNo, llvm::Attribute::getWithAlignment(
+                                  Context, DL.getABITypeAlign(Ty)));
+      continue;
+    }
+    const PointerQualType *PT = dynamic_cast<const PointerQualType*>(ParamTys[Idx]);
+    // a string reference is the character pointer itself, of unknown length
+    if (!PT || PT->getElemType()->getTypeID() == QualType::T_string) {
+      continue;
+    }
+    llvm::Type *ElemTy = convertType(PT->getElemType());
+    if (!ElemTy || !ElemTy->isSized()) {
+      continue;
+    }
+    // a reference points to a live object nobody else writes during the call
+    Fn->addParamAttr(ArgNo, llvm::Attribute::NonNull);
+    Fn->addParamAttr(ArgNo, llvm::Attribute::NoUndef);
+    Fn->addParamAttr(ArgNo, llvm::Attribute::NoAlias);
+    Fn->addDereferenceableParamAttr(ArgNo, DL.getTypeAllocSize(ElemTy));
+    if (!PT->isMut()) {
+      Fn->addParamAttr(ArgNo, llvm::Attribute::ReadOnly);
+    }
+  }
+}
+
+void CodeGen::removeUnreachableFns() {
+  llvm::Function *Main = Module.getFunction("main");
+  if (!Main) {
+    return;
+  }
+  std::unordered_set<llvm::Function *> Live{Main};
+  std::vector<llvm::Function *> Work{Main};
+  while (!Work.empty()) {
+    llvm::Function *F = Work.back();
+    Work.pop_back();
+    for (llvm::Instruction &I : llvm::instructions(*F)) {
+      for (llvm::Value *Op : I.operands()) {
+        auto *Callee = llvm::dyn_cast<llvm::Function>(Op);
+        if (Callee && Live.insert(Callee).second) {
+          Work.push_back(Callee);
+        }
+      }
+    }
+  }
 
-  std::vector<llvm::Value *> Args = {
-      Dest, Src, llvm::ConstantInt::get(llvm::Type::getInt32Ty(Context), SizeInBytes)};
-  Builder.CreateCall(Fn, Args);
+  std::vector<llvm::Function *> Dead;
+  for (llvm::Function &F : Module) {
+    if (!Live.count(&F)) {
+      Dead.push_back(&F);
+    }
+  }
+  // dead functions may call each other
+  for (llvm::Function *F : Dead) {
+    F->dropAllReferences();
+  }
+  for (llvm::Function *F : Dead) {
+    F->eraseFromParent();
+  }
+}
+
+// whether I touches no memory but the frame of its function, calls aside
+static bool accessesOnlyLocals(const llvm::Instruction &I) {
+  auto isLocal = [](const llvm::Value *Ptr) {
+    const llvm::Value *Obj = llvm::getUnderlyingObject(Ptr);
+    return llvm::isa<llvm::AllocaInst>(Obj);
+  };
+  auto isConstant = [](const llvm::Value *Ptr) {
+    auto *GV = llvm::dyn_cast<llvm::GlobalVariable>(llvm::getUnderlyingObject(Ptr));
+    return GV && GV->isConstant();
+  };
+  if (auto *LI = llvm::dyn_cast<llvm::LoadInst>(&I)) {
+    return !LI->isVolatile() &&
+           (isLocal(LI->getPointerOperand()) || isConstant(LI->getPointerOperand()));
+  }
+  if (auto *SI = llvm::dyn_cast<llvm::StoreInst>(&I)) {
+    return !SI->isVolatile() && isLocal(SI->getPointerOperand());
+  }
+  if (auto *MT = llvm::dyn_cast<llvm::MemTransferInst>(&I)) {
+    return isLocal(MT->getRawDest()) &&
+           (isLocal(MT->getRawSource()) || isConstant(MT->getRawSource()));
+  }
+  if (auto *MS = llvm::dyn_cast<llvm::MemSetInst>(&I)) {
+    return isLocal(MS->getRawDest());
+  }
+  if (llvm::isa<llvm::CallBase>(&I)) {
+    return true; // judged by the callee
+  }
+  return !I.mayReadOrWriteMemory();
+}
+
+void CodeGen::inferFnAttrs() {
+  // memory(none) from the optimistic side: a recursive cycle that touches
+  // no memory stays pure
+  std::unordered_set<llvm::Function *> Pure;
+  for (llvm::Function &F : Module) {
+    if (F.isDeclaration()) {
+      continue;
+    }
+    bool Local = true;
+    for (llvm::Instruction &I : llvm::instructions(F)) {
+      Local = Local && accessesOnlyLocals(I);
+    }
+    if (Local) {
+      Pure.insert(&F);
+    }
+  }
+  auto callsOnly = [](llvm::Function &F, auto Pred) {
+    for (llvm::Instruction &I : llvm::instructions(F)) {
+      auto *Call = llvm::dyn_cast<llvm::CallBase>(&I);
+      // lifetime markers touch no memory, whatever their declaration says
+      if (!Call || llvm::isa<llvm::MemIntrinsic>(Call) ||
+          llvm::isa<llvm::LifetimeIntrinsic>(Call)) {
+        continue;
+      }
+      llvm::Function *Callee = Call->getCalledFunction();
+      if (!Callee || !Pred(Callee)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  for (bool Changed = true; Changed;) {
+    Changed = false;
+    for (auto It = Pure.begin(); It != Pure.end();) {
+      if (callsOnly(**It, [&](llvm::Function *Callee) { return Pure.count(Callee) > 0; })) {
+        ++It;
+      } else {
+        It = Pure.erase(It);
+        Changed = true;
+      }
+    }
+  }
+
+  // willreturn from the pessimistic side: no loops, and the callees return
+  std::unordered_set<llvm::Function *> Returns;
+  for (bool Changed = true; Changed;) {
+    Changed = false;
+    for (llvm::Function *F : Pure) {
+      if (Returns.count(F)) {
+        continue;
+      }
+      llvm::SmallVector<std::pair<const llvm::BasicBlock *, const llvm::BasicBlock *>, 4> BackEdges;
+      llvm::FindFunctionBackedges(*F, BackEdges);
+      if (BackEdges.empty() &&
+          callsOnly(*F, [&](llvm::Function *Callee) { return Returns.count(Callee) > 0; })) {
+        Returns.insert(F);
+        Changed = true;
+      }
+    }
+  }
+
+  for (llvm::Function *F : Pure) {
+    F->setDoesNotAccessMemory();
+    if (Returns.count(F)) {
+      F->addFnAttr(llvm::Attribute::WillReturn);
+    }
+  }
+}
+
+void CodeGen::emitBoundsCheck(llvm::Value *Idx, uint64_t Length) {
+  auto *C = llvm::dyn_cast<llvm::ConstantInt>(Idx);
+  if (C && C->getValue().ult(Length)) {
+    NumBoundsChecksFolded++;
+    return;
+  }
+  NumBoundsChecks++;
+
+  llvm::Function *Fn = Builder.GetInsertBlock()->getParent();
+  llvm::BasicBlock *&Fail = BoundsFailBB[Fn];
+  if (!Fail) {
+    // shared by all checks of the function, a panic exits with 101
+    Fail = llvm::BasicBlock::Create(Context, "boundsfail", Fn);
+    llvm::IRBuilder<> FailB(Fail);
+    llvm::CallInst *Exit =
+        FailB.CreateCall(Module.getFunction("exit"), FailB.getInt32(101));
+    Exit->addFnAttr(llvm::Attribute::Cold);
+    FailB.CreateUnreachable();
+  }
+
+  llvm::Value *InBounds =
+      Builder.CreateICmpULT(Idx, llvm::ConstantInt::get(Idx->getType(), Length), "inbounds");
+  llvm::BasicBlock *Ok = llvm::BasicBlock::Create(Context, "inbounds", Fn);
+  Builder.CreateCondBr(InBounds, Ok, Fail,
+                       llvm::MDBuilder(Context).createBranchWeights((1U << 20) - 1, 1));
+  SSA.seal(Ok);
+  Builder.SetInsertPoint(Ok);
+}
+
+void CodeGen::eliminateBoundsChecks() {
+  llvm::TargetLibraryInfoImpl TLII(llvm::Triple(Module.getTargetTriple()));
+  llvm::TargetLibraryInfo TLI(TLII);
+  for (auto &[Fn, Fail] : BoundsFailBB) {
+    std::vector<llvm::BranchInst *> Redundant;
+    {
+      llvm::DominatorTree DT(*Fn);
+      llvm::LoopInfo LI(DT);
+      llvm::AssumptionCache AC(*Fn);
+      llvm::ScalarEvolution SE(*Fn, TLI, AC, DT, LI);
+      for (llvm::BasicBlock *Pred : llvm::predecessors(Fail)) {
+        auto *Br = llvm::cast<llvm::BranchInst>(Pred->getTerminator());
+        auto *Cmp = llvm::cast<llvm::ICmpInst>(Br->getCondition());
+        // the guards of dominating branches, loop conditions among them
+        if (SE.isKnownPredicateAt(llvm::ICmpInst::ICMP_ULT,
+                                  SE.getSCEV(Cmp->getOperand(0)),
+                                  SE.getSCEV(Cmp->getOperand(1)), Br)) {
+          Redundant.push_back(Br);
+        }
+      }
+    }
+
+    for (llvm::BranchInst *Br : Redundant) {
+      auto *Cmp = llvm::cast<llvm::ICmpInst>(Br->getCondition());
+      llvm::BranchInst::Create(Br->getSuccessor(0), Br);
+      Br->eraseFromParent();
+      if (Cmp->use_empty()) {
+        Cmp->eraseFromParent();
+      }
+    }
+    NumBoundsChecksRemoved += Redundant.size();
+    if (llvm::pred_empty(Fail)) {
+      Fail->eraseFromParent();
+    }
+  }
+  BoundsFailBB.clear();
+}
+
+void CodeGen::reportBoundsChecks(std::ostream &OS) const {
+  unsigned Total = NumBoundsChecks + NumBoundsChecksFolded;
+  OS << "bounds checks: " << Total << " index expressions, "
+     << NumBoundsChecksFolded << " folded at compile time, "
+     << NumBoundsChecksRemoved << " removed after lowering, "
+     << NumBoundsChecks - NumBoundsChecksRemoved << " left\n";
+}
+
+void CodeGen::createConstantInit(llvm::Value *Dest, llvm::Constant *Init) {
+  const llvm::DataLayout &DL = Module.getDataLayout();
+  llvm::Type *Ty = Init->getType();
+  llvm::Align Alignment = DL.getABITypeAlign(Ty);
+
+  llvm::Value *Byte = llvm::isBytewiseValue(Init, DL);
+  if (Byte && llvm::isa<llvm::ConstantInt>(Byte)) {
+    Builder.CreateMemSet(Dest, Byte, DL.getTypeAllocSize(Ty), Alignment);
+    return;
+  }
+
+  createMemCpy(Dest, getConstantPoolEntry(Init), Ty);
+}
+
+llvm::GlobalVariable *CodeGen::getConstantPoolEntry(llvm::Constant *Init) {
+  // constants are uniqued, equal initializers share one global
+  auto It = ConstantPool.find(Init);
+  if (It != ConstantPool.end()) {
+    return It->second;
+  }
+  auto *GV = new llvm::GlobalVariable(Module, Init->getType(), true,
+                                      llvm::GlobalValue::PrivateLinkage, Init,
+                                      "constinit");
+  GV->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+  GV->setAlignment(Module.getDataLayout().getABITypeAlign(Init->getType()));
+  ConstantPool[Init] = GV;
+  return GV;
+}
+
+llvm::Constant *CodeGen::getConstant(const ExprNode &N) {
+  switch (N.getTypeID()) {
+  default:
+    return nullptr;
+  case ASTNode::K_ExprLiteralBool:
+  case ASTNode::K_ExprLiteralChar:
+  case ASTNode::K_ExprLiteralInt:
+  case ASTNode::K_ExprPath: {
+    // these emit no instruction but phis, a local yields its alloca or value;
+    // a pooled array yields its global, an address rather than the value
+    auto *C = llvm::dyn_cast_or_null<llvm::Constant>(emitExprNode(N));
+    if (C && (llvm::isa<llvm::ConstantInt>(C) ||
+              C->getType() == convertType(N.getQualType()))) {
+      return C;
+    }
+    return nullptr;
+  }
+  case ASTNode::K_ExprGrouped:
+    return getConstant(*static_cast<const ExprGrouped &>(N).expr);
+  case ASTNode::K_ExprOpUnary: {
+    const auto &U = static_cast<const ExprOpUnary &>(N);
+    llvm::Constant *C = getConstant(*U.expr);
+    if (!C) {
+      return nullptr;
+    }
+    if (U.type == NEGATE_) {
+      return llvm::ConstantExpr::getNeg(C);
+    } else if (U.type == NOT_) {
+      return llvm::ConstantExpr::getNot(C);
+    }
+    return nullptr;
+  }
+  case ASTNode::K_ExprOpCast: {
+    const auto &Cast = static_cast<const ExprOpCast &>(N);
+    llvm::Constant *C = getConstant(*Cast.expr);
+    if (!C || !C->getType()->isIntegerTy()) {
+      return nullptr;
+    }
+    return llvm::ConstantExpr::getIntegerCast(C, convertType(N.getQualType()),
+                                              !Cast.expr->getQualType()->isUnsigned());
+  }
+  case ASTNode::K_ExprArrayExpand: {
+    const auto &A = static_cast<const ExprArrayExpand &>(N);
+    std::vector<llvm::Constant *> Elems;
+    for (auto &E : A.elements) {
+      llvm::Constant *C = getConstant(*E);
+      if (!C) {
+        return nullptr;
+      }
+      Elems.push_back(C);
+    }
+    auto *Ty = llvm::cast<llvm::ArrayType>(convertType(N.getQualType()));
+    return llvm::ConstantArray::get(Ty, Elems);
+  }
+  case ASTNode::K_ExprArrayAbbreviate: {
+    const auto &A = static_cast<const ExprArrayAbbreviate &>(N);
+    auto *Ty = llvm::cast<llvm::ArrayType>(convertType(N.getQualType()));
+    llvm::Constant *C = getConstant(*A.value);
+    if (!C) {
+      return nullptr;
+    }
+    if (C->isNullValue()) {
+      return llvm::ConstantAggregateZero::get(Ty);
+    }
+    if (Module.getDataLayout().getTypeAllocSize(Ty) > MaxConstantPoolSize) {
+      return nullptr; // too large to materialize, filled by a loop instead
+    }
+    return llvm::ConstantArray::get(
+        Ty, std::vector<llvm::Constant *>(Ty->getNumElements(), C));
+  }
+  }
 }
 
 void CodeGen::emitItemNode(const ItemNode &N) {
@@ -186,7 +958,7 @@ void CodeGen::emitItemNode(const ItemNode &N) {
 }
 
 llvm::Value *CodeGen::getValue(llvm::Value *value, const QualType *Ty) {
-  if (value->getType()->isPointerTy()) {
+  if (value->getType()->isPointerTy() && !isStringLiteral(value)) {
     return Builder.CreateLoad(convertType(Ty), value);
   }
   return value;
@@ -303,9 +1075,10 @@ llvm::Type *CodeGen::convertType(const QualType *Ty) {
   case QualType::T_intLiteral:
   case QualType::T_i32:
   case QualType::T_u32:
+    return llvm::Type::getInt32Ty(Context);
   case QualType::T_isize:
   case QualType::T_usize:
-    return llvm::Type::getInt32Ty(Context);
+    return Module.getDataLayout().getIntPtrType(Context);
   case QualType::T_string:
     return llvm::PointerType::get(llvm::Type::getInt8Ty(Context), 0);
   case QualType::T_struct: {
@@ -316,8 +1089,7 @@ llvm::Type *CodeGen::convertType(const QualType *Ty) {
     return llvm::Type::getVoidTy(Context);
   case QualType::T_ptr: {
     const PointerQualType *P = dynamic_cast<const PointerQualType*>(Ty);
-    llvm::Type *ElemType = convertType(P->getElemType());
-    return llvm::PointerType::get(ElemType, 0);
+    return llvm::PointerType::get(Context, 0);
   }
   case QualType::T_array: {
     const ArrayQualType *A = dynamic_cast<const ArrayQualType*>(Ty);
@@ -330,6 +1102,23 @@ llvm::Type *CodeGen::convertType(const QualType *Ty) {
   }
 }
 
+bool CodeGen::isIndirectParam(const QualType *Ty) {
+  if (!Ty->isStruct() && !Ty->isArray()) {
+    return false;
+  }
+  // small aggregates travel in registers
+  llvm::Type *T = convertType(Ty);
+  return T && T->isSized() &&
+         Module.getDataLayout().getTypeAllocSize(T) > MaxDirectArgSize;
+}
+
+llvm::Type *CodeGen::convertParamType(const QualType *Ty) {
+  if (isIndirectParam(Ty)) {
+    return llvm::PointerType::get(Context, 0);
+  }
+  return convertType(Ty);
+}
+
 std::vector<llvm::Type *> CodeGen::getFnParamTypes(const FnParameters &FnParams) {
   std::vector<llvm::Type *> Types;
 
@@ -361,20 +1150,37 @@ void CodeGen::emitFnParam(const FnParameters &FnParams,
   }
 
   assert(paramNames.size() == paramTypes.size());
+  unsigned ArgBase = Fn->hasStructRetAttr() ? 1 : 0; // skip the result pointer
   for (size_t Idx = 0; Idx < paramNames.size(); Idx++) {
     llvm::Type *Ty = convertType(paramTypes[Idx]);
     std::string &Name = paramNames[Idx];
+    if (isIndirectParam(paramTypes[Idx])) {
+      // the caller made a copy for us, it is the parameter's home
+      Fn->getArg(ArgBase + Idx)->setName(Name);
+      AllocaAddr[Name] = Fn->getArg(ArgBase + Idx);
+      continue;
+    }
+    if (isSSALocal(Name, Ty)) {
+      Fn->getArg(ArgBase + Idx)->setName(Name);
+      SSA.declare(Name, Ty);
+      SSA.write(Name, Builder.GetInsertBlock(), Fn->getArg(ArgBase + Idx));
+      continue;
+    }
     llvm::AllocaInst *Alloca = createAlloca(Ty, nullptr, Name);
 
-    Builder.CreateStore(Fn->getArg(Idx), Alloca);
+    Builder.CreateStore(Fn->getArg(ArgBase + Idx), Alloca);
     AllocaAddr[Name] = Alloca;
+    if (!CurrentFn->containVarDecl(Name) || !CurrentFn->getVarDecl(Name).mut) {
+      ParamSlots.insert(Alloca);
+    }
   }
   if (FnType->getReturnType()->isStruct() ||
       FnType->getReturnType()->isArray()) {
-    ReturnValue = Fn->getArg(Fn->arg_size() - 1);
+    ReturnValue = Fn->getArg(0);
   } else if (!FnType->getReturnType()->isVoid()) {
-    ReturnValue = Builder.CreateAlloca(convertType(FnType->getReturnType()),
-                                       nullptr, "returnvalue");
+    // every return adds an incoming value
+    ReturnValue = llvm::PHINode::Create(convertType(FnType->getReturnType()), 0,
+                                        "returnvalue", Exit);
   } else {
     ReturnValue = nullptr;
   }
@@ -383,6 +1189,9 @@ void CodeGen::emitFnParam(const FnParameters &FnParams,
 void CodeGen::emitItemFn(const ItemFn &N) {
   CurrentFn = const_cast<ItemFn *>(&N);
   AllocaAddr.clear();
+  SSA.clear();
+  ParamSlots.clear();
+  TailCalls.clear();
 
   std::string FnName = CurrentImpl == nullptr
                            ? N.identifier
@@ -395,35 +1204,61 @@ void CodeGen::emitItemFn(const ItemFn &N) {
   Exit = llvm::BasicBlock::Create(Context, "exit", Fn);
 
   Builder.SetInsertPoint(Entry);
+  SSA.seal(Entry);
 
   const FuncQualType *FnType = N.getQualType();
 
   emitFnParam(N.function_parameters, FnType);
 
-  llvm::Value *V = emitExprBlock(*N.block_expr);
-  if (V) {
-    if (N.block_expr->getQualType()->isStruct() ||
-        N.block_expr->getQualType()->isArray()) {
-      llvm::Type *DeclTy = convertType(N.block_expr->getQualType());
-      createMemCpy(ReturnValue, V, DeclTy);
-      V = nullptr;
-    } else {
-      V = getValue(V, N.getQualType()->getReturnType());
+  collectTailCalls(N.block_expr.get(), true, FnType->getReturnType()->isVoid(), TailCalls);
+  TailRecurseBB = nullptr;
+  for (const ExprNode *Call : TailCalls) {
+    const ExprPath *EP = Call->getTypeID() == ASTNode::K_ExprCall
+                             ? dynamic_cast<const ExprPath *>(
+                                   static_cast<const ExprCall *>(Call)->expr.get())
+                             : nullptr;
+    if (EP && extractManglePathIdentifier(*EP) == FnName &&
+        !N.function_parameters.self_param.flag) {
+      // the loop the self tail calls turn into, entered once from here
+      TailRecurseBB = llvm::BasicBlock::Create(Context, "tailrecurse", Fn);
+      Builder.CreateBr(TailRecurseBB);
+      Builder.SetInsertPoint(TailRecurseBB);
+      break;
     }
   }
 
+  llvm::Value *V = nullptr;
+  if (N.block_expr->getQualType()->isStruct() ||
+      N.block_expr->getQualType()->isArray()) {
+    // the result is built in the caller's slot
+    emitExprInto(*N.block_expr, ReturnValue);
+  } else if ((V = emitExprBlock(*N.block_expr))) {
+    V = getValue(V, N.block_expr->getQualType());
+    V = castInt(V, N.block_expr->getQualType(), convertType(FnType->getReturnType()));
+  }
+
   llvm::BasicBlock *BB = Builder.GetInsertBlock();
+  auto *RetPhi = llvm::dyn_cast_or_null<llvm::PHINode>(ReturnValue);
   if (BB->getTerminator() == nullptr) {
-    if (V) {
-      Builder.CreateStore(V, ReturnValue);
+    if (RetPhi) {
+      // falling off the end after a return statement yields nothing
+      RetPhi->addIncoming(V ? V : llvm::PoisonValue::get(RetPhi->getType()), BB);
     }
     Builder.CreateBr(Exit);
   }
+  if (TailRecurseBB) {
+    SSA.seal(TailRecurseBB); // every self tail call is emitted
+  }
 
   Builder.SetInsertPoint(Exit);
-  if (!Fn->getReturnType()->isVoidTy()) {
-    Builder.CreateRet(Builder.CreateLoad(
-        convertType(N.getQualType()->getReturnType()), ReturnValue));
+  if (RetPhi) {
+    llvm::Value *RetV = RetPhi;
+    if (RetPhi->getNumIncomingValues() == 0) {
+      // Exit is unreachable, a phi needs at least one entry
+      RetV = llvm::PoisonValue::get(RetPhi->getType());
+      RetPhi->eraseFromParent();
+    }
+    Builder.CreateRet(RetV);
   } else {
     Builder.CreateRetVoid();
   }
@@ -435,6 +1270,7 @@ void CodeGen::emitItemFn(const ItemFn &N) {
 
   CurrentFn = nullptr;
   ReturnValue = nullptr;
+  TailRecurseBB = nullptr;
 }
 
 void CodeGen::emitItemImpl(const ItemImpl &N) {
@@ -463,46 +1299,69 @@ void CodeGen::emitStmtLet(const StmtLet &N) {
   assert(Pat != nullptr);
 
   llvm::Type *Ty = getType(N.type.get());
+
+  // an immutable constant array is read in place from the constant pool
+  const VarDecl &Decl = CurrentFn->getVarDecl(Pat->identifier);
+  if (!Decl.mut && Decl.Ty->isArray()) {
+    llvm::Constant *Init = getConstant(*N.expr);
+    if (Init && Module.getDataLayout().getTypeAllocSize(Init->getType()) <=
+                    MaxConstantPoolSize) {
+      AllocaAddr[Pat->identifier] = getConstantPoolEntry(Init);
+      return;
+    }
+  }
+
+  llvm::Type *DeclTy = convertType(Decl.Ty);
+  if (N.expr->getQualType()->isStruct() || N.expr->getQualType()->isArray()) {
+    // constructed in place, the variable is not visible to its initializer
+    llvm::AllocaInst *Alloca = createAlloca(DeclTy, nullptr, Pat->identifier);
+    emitExprInto(*N.expr, Alloca);
+    AllocaAddr[Pat->identifier] = Alloca;
+    return;
+  }
+
   llvm::Value *InitVal = emitExprNode(*N.expr);
   if (Builder.GetInsertBlock()->getTerminator()) {
     return;
   }
-  llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
-  llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
-                   TheFunction->getEntryBlock().begin());
+  InitVal = castInt(getValue(InitVal, N.expr->getQualType()), N.expr->getQualType(), DeclTy);
+  if (isSSALocal(Pat->identifier, DeclTy)) {
+    SSA.declare(Pat->identifier, DeclTy);
+    SSA.write(Pat->identifier, Builder.GetInsertBlock(), InitVal);
+    return;
+  }
 
-  const VarDecl &Decl = CurrentFn->getVarDecl(Pat->identifier);
-  llvm::AllocaInst *Alloca1 =
-      TmpB.CreateAlloca(convertType(Decl.Ty), nullptr, Pat->identifier);
+  llvm::AllocaInst *Alloca1 = createAlloca(DeclTy, nullptr, Pat->identifier);
   AllocaAddr[Pat->identifier] = Alloca1;
 
-  if (N.expr->getQualType()->isStruct() || N.expr->getQualType()->isArray()) {
-    createMemCpy(Alloca1, InitVal, convertType(Decl.Ty));
-    return;
-  }
-  Builder.CreateStore(getValue(InitVal, N.expr->getQualType()), Alloca1);
+  Builder.CreateStore(InitVal, Alloca1);
 }
 
-void CodeGen::emitStmtExpr(const StmtExpr &N) { emitExprNode(*N.expr); }
+void CodeGen::emitStmtExpr(const StmtExpr &N) {
+  // the value is dropped, so are the temporaries; those of a let live on
+  // with the block, its variable may borrow them
+  pushLifetimeScope();
+  emitExprNode(*N.expr);
+  popLifetimeScope(false);
+}
 
 llvm::Value *CodeGen::emitExprLiteralChar(const ExprLiteralChar &N) {
   return llvm::ConstantInt::get(llvm::Type::getInt8Ty(Context), N.literal);
 }
 
 llvm::Value *CodeGen::emitExprLiteralString(const ExprLiteralString &N) {
-  llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
-  llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
-                   TheFunction->getEntryBlock().begin());
-  llvm::AllocaInst *Alloca = TmpB.CreateAlloca(
-      llvm::PointerType::get(llvm::PointerType::get(llvm::Type::getInt8Ty(Context), 0), 0),
-      nullptr, "globalstring");
-  llvm::Value *value = Builder.CreateGlobalStringPtr(llvm::StringRef(N.literal));
-  Builder.CreateStore(value, Alloca);
-  return Alloca;
+  llvm::GlobalVariable *&GV = StringPool[N.literal];
+  if (!GV) {
+    // private & unnamed_addr, so equal literals of other modules merge too
+    GV = Builder.CreateGlobalString(N.literal, ".str", 0, &Module);
+    StringLiterals.insert(GV);
+  }
+  return GV;
 }
 
 llvm::Value *CodeGen::emitExprLiteralInt(const ExprLiteralInt &N) {
-  return llvm::ConstantInt::get(llvm::Type::getInt32Ty(Context), N.literal);
+  // a literal whose type no context settled is an i32
+  return llvm::ConstantInt::get(convertType(N.getQualType()), N.literal);
 }
 
 llvm::Value *CodeGen::emitExprLiteralBool(const ExprLiteralBool &N) {
@@ -514,12 +1373,13 @@ llvm::Value *CodeGen::emitExprPath(const ExprPath &N) {
     switch (N.path1->type) {
     case PathType::Identifier:
       // This only process local variable and const
+      if (SSA.contains(N.path1->identifier))
+        return SSA.read(N.path1->identifier, Builder.GetInsertBlock());
       if (AllocaAddr.count(N.path1->identifier))
         return AllocaAddr[N.path1->identifier];
       if (Syms.constTable.count(N.path1->identifier)) {
         int64_t Value = Syms.constTable.getValue(N.path1->identifier);
-        llvm::Type *ITy = llvm::Type::getInt32Ty(Context);
-        return llvm::ConstantInt::get(ITy, Value);
+        return llvm::ConstantInt::get(convertType(N.getQualType()), Value);
       }
       llvm_unreachable("unexpected type here");
     case PathType::self: {
@@ -540,13 +1400,21 @@ llvm::Value *CodeGen::emitExprPath(const ExprPath &N) {
 }
 
 llvm::Value *CodeGen::emitExprBlock(const ExprBlock &N) {
+  llvm::Value *Dest = takeInPlaceAddr(N);
+  pushLifetimeScope();
   for (auto &ST : N.stmts) {
     emitStmtNode(*ST);
   }
-  if (N.expr) {
-    return emitExprNode(*N.expr);
-  }
-  return nullptr;
+  llvm::Value *V = nullptr;
+  if (N.expr && Dest) {
+    emitExprInto(*N.expr, Dest);
+    V = Dest;
+  } else if (N.expr) {
+    V = emitExprNode(*N.expr);
+  }
+  // an address may point into the block's own slots, read after it ends
+  popLifetimeScope(V && V != Dest && V->getType()->isPointerTy() && !isStringLiteral(V));
+  return V;
 }
 
 llvm::Value *CodeGen::emitExprOpUnary(const ExprOpUnary &N) {
@@ -554,6 +1422,16 @@ llvm::Value *CodeGen::emitExprOpUnary(const ExprOpUnary &N) {
   switch (N.type) {
   case BORROW_:       // & | &&
   case MUT_BORROW_: { // & | && mut
+    if (!Val->getType()->isPointerTy() || isStringLiteral(Val)) {
+      // a scalar rvalue has no address, borrow a temporary holding it
+      llvm::AllocaInst *Tmp = createAlloca(Val->getType(), nullptr, "borrowtmp");
+      Builder.CreateStore(Val, Tmp);
+      Val = Tmp;
+    }
+    if (!dynamic_cast<const ExprPath *>(stripGrouped(N.expr.get()))) {
+      // a borrowed temporary may be promoted to outlive its statement
+      pinLifetime(Val);
+    }
     llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
     llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
                      TheFunction->getEntryBlock().begin());
@@ -595,6 +1473,7 @@ llvm::Value *CodeGen::emitExprOpBinary(const ExprOpBinary &N) {
     llvm::BasicBlock *MergeBB = llvm::BasicBlock::Create(Context, "and.merge");
 
     Builder.CreateCondBr(L, RHSBB, MergeBB);
+    SSA.seal(RHSBB);
 
     Builder.SetInsertPoint(RHSBB);
     llvm::Value *R = getValue(emitExprNode(*N.right), N.right->getQualType());
@@ -609,6 +1488,7 @@ llvm::Value *CodeGen::emitExprOpBinary(const ExprOpBinary &N) {
     RHSBB = Builder.GetInsertBlock();
 
     TheFunction->insert(TheFunction->end(), MergeBB);
+    SSA.seal(MergeBB);
     Builder.SetInsertPoint(MergeBB);
     llvm::PHINode *PN = Builder.CreatePHI(llvm::Type::getInt1Ty(Context), 2, "andtmp");
     PN->addIncoming(llvm::ConstantInt::get(llvm::Type::getInt1Ty(Context), 0), LHSBB);
@@ -630,6 +1510,7 @@ llvm::Value *CodeGen::emitExprOpBinary(const ExprOpBinary &N) {
     llvm::BasicBlock *MergeBB = llvm::BasicBlock::Create(Context, "or.merge");
 
     Builder.CreateCondBr(L, MergeBB, RHSBB);
+    SSA.seal(RHSBB);
 
     Builder.SetInsertPoint(RHSBB);
     llvm::Value *R = getValue(emitExprNode(*N.right), N.right->getQualType());
@@ -642,6 +1523,7 @@ llvm::Value *CodeGen::emitExprOpBinary(const ExprOpBinary &N) {
     RHSBB = Builder.GetInsertBlock();
 
     TheFunction->insert(TheFunction->end(), MergeBB);
+    SSA.seal(MergeBB);
     Builder.SetInsertPoint(MergeBB);
     llvm::PHINode *PN = Builder.CreatePHI(llvm::Type::getInt1Ty(Context), 2, "ortmp");
     PN->addIncoming(llvm::ConstantInt::get(llvm::Type::getInt1Ty(Context), 1), LHSBB);
@@ -649,15 +1531,36 @@ llvm::Value *CodeGen::emitExprOpBinary(const ExprOpBinary &N) {
     return PN;
   }
 
-  llvm::Value *LAddr = emitExprNode(*N.left);
+  // an SSA local has no address, it is read after the RHS like a load
+  std::string Var = getSSAPlace(*N.left);
+  llvm::Value *LAddr = Var.empty() ? emitExprNode(*N.left) : nullptr;
   llvm::Value *RHS = getValue(emitExprNode(*N.right), N.right->getQualType());
+  const QualType *LQTy = N.left->getQualType();
+  const QualType *RQTy = N.right->getQualType();
+  if (N.type >= ExprOpBinaryType::ASSIGN_ || N.type == ExprOpBinaryType::SHL_ ||
+      N.type == ExprOpBinaryType::SHR_) {
+    RHS = castInt(RHS, RQTy, convertType(LQTy));
+  }
 
   if (N.type == ExprOpBinaryType::ASSIGN_) {
-    Builder.CreateStore(RHS, LAddr);
+    if (!Var.empty()) {
+      SSA.write(Var, Builder.GetInsertBlock(), RHS);
+    } else {
+      Builder.CreateStore(RHS, LAddr);
+    }
     return nullptr;
   }
 
-  llvm::Value *LHS = getValue(LAddr, N.left->getQualType());
+  llvm::Value *LHS = Var.empty() ? getValue(LAddr, N.left->getQualType())
+                                 : SSA.read(Var, Builder.GetInsertBlock());
+  if (LQTy->isIntLiteral()) {
+    // the literal side follows the typed one
+    LHS = castInt(LHS, LQTy, RHS->getType());
+    LQTy = RQTy;
+  } else {
+    RHS = castInt(RHS, RQTy, LHS->getType());
+  }
+  bool Unsigned = LQTy->isUnsigned();
   llvm::Value *Result = nullptr;
   switch (N.type) {
   case ExprOpBinaryType::PLUS_EQ_:
@@ -670,10 +1573,10 @@ llvm::Value *CodeGen::emitExprOpBinary(const ExprOpBinary &N) {
     Result = Builder.CreateMul(LHS, RHS);
     break;
   case ExprOpBinaryType::DIV_EQ_:
-    Result = Builder.CreateSDiv(LHS, RHS);
+    Result = Unsigned ? Builder.CreateUDiv(LHS, RHS) : Builder.CreateSDiv(LHS, RHS);
     break;
   case ExprOpBinaryType::MOD_EQ_:
-    Result = Builder.CreateSRem(LHS, RHS);
+    Result = Unsigned ? Builder.CreateURem(LHS, RHS) : Builder.CreateSRem(LHS, RHS);
     break;
   case ExprOpBinaryType::AND_EQ_:
     Result = Builder.CreateAnd(LHS, RHS);
@@ -688,13 +1591,17 @@ llvm::Value *CodeGen::emitExprOpBinary(const ExprOpBinary &N) {
     Result = Builder.CreateShl(LHS, RHS);
     break;
   case ExprOpBinaryType::SHR_EQ_:
-    Result = Builder.CreateAShr(LHS, RHS);
+    Result = Unsigned ? Builder.CreateLShr(LHS, RHS) : Builder.CreateAShr(LHS, RHS);
     break;
   default:
     break;
   }
   if (Result) {
-    Builder.CreateStore(Result, LAddr);
+    if (!Var.empty()) {
+      SSA.write(Var, Builder.GetInsertBlock(), Result);
+    } else {
+      Builder.CreateStore(Result, LAddr);
+    }
     return nullptr;
   }
 
@@ -706,9 +1613,11 @@ llvm::Value *CodeGen::emitExprOpBinary(const ExprOpBinary &N) {
   case ExprOpBinaryType::MUL_:
     return Builder.CreateMul(LHS, RHS, "multmp");
   case ExprOpBinaryType::DIV_:
-    return Builder.CreateSDiv(LHS, RHS, "divtmp");
+    return Unsigned ? Builder.CreateUDiv(LHS, RHS, "divtmp")
+                    : Builder.CreateSDiv(LHS, RHS, "divtmp");
   case ExprOpBinaryType::MOD_:
-    return Builder.CreateSRem(LHS, RHS, "modtmp");
+    return Unsigned ? Builder.CreateURem(LHS, RHS, "modtmp")
+                    : Builder.CreateSRem(LHS, RHS, "modtmp");
   case ExprOpBinaryType::AND_:
     return Builder.CreateAnd(LHS, RHS, "andtmp");
   case ExprOpBinaryType::OR_:
@@ -718,19 +1627,24 @@ llvm::Value *CodeGen::emitExprOpBinary(const ExprOpBinary &N) {
   case ExprOpBinaryType::SHL_:
     return Builder.CreateShl(LHS, RHS, "shltmp");
   case ExprOpBinaryType::SHR_:
-    return Builder.CreateAShr(LHS, RHS, "shrtmp");
+    return Unsigned ? Builder.CreateLShr(LHS, RHS, "shrtmp")
+                    : Builder.CreateAShr(LHS, RHS, "shrtmp");
   case ExprOpBinaryType::EQUAL_:
     return Builder.CreateICmpEQ(LHS, RHS, "cmptmp");
   case ExprOpBinaryType::NOT_EQUAL_:
     return Builder.CreateICmpNE(LHS, RHS, "cmptmp");
   case ExprOpBinaryType::LESS_:
-    return Builder.CreateICmpSLT(LHS, RHS, "cmptmp");
+    return Unsigned ? Builder.CreateICmpULT(LHS, RHS, "cmptmp")
+                    : Builder.CreateICmpSLT(LHS, RHS, "cmptmp");
   case ExprOpBinaryType::LESS_EQUAL_:
-    return Builder.CreateICmpSLE(LHS, RHS, "cmptmp");
+    return Unsigned ? Builder.CreateICmpULE(LHS, RHS, "cmptmp")
+                    : Builder.CreateICmpSLE(LHS, RHS, "cmptmp");
   case ExprOpBinaryType::GREATER_:
-    return Builder.CreateICmpSGT(LHS, RHS, "cmptmp");
+    return Unsigned ? Builder.CreateICmpUGT(LHS, RHS, "cmptmp")
+                    : Builder.CreateICmpSGT(LHS, RHS, "cmptmp");
   case ExprOpBinaryType::GREATER_EQUAL_:
-    return Builder.CreateICmpSGE(LHS, RHS, "cmptmp");
+    return Unsigned ? Builder.CreateICmpUGE(LHS, RHS, "cmptmp")
+                    : Builder.CreateICmpSGE(LHS, RHS, "cmptmp");
   default:
     llvm_unreachable("");
   }
@@ -739,10 +1653,14 @@ llvm::Value *CodeGen::emitExprOpBinary(const ExprOpBinary &N) {
 llvm::Value *CodeGen::emitExprOpCast(const ExprOpCast &N) {
   llvm::Value *Val = emitExprNode(*N.expr);
   Val = getDerefValue(Val, N.expr->getQualType());
-  return Builder.CreateIntCast(Val, convertType(N.getQualType()), true);
+  return castInt(Val, N.expr->getQualType(), convertType(N.getQualType()));
 }
 
 llvm::Value *CodeGen::emitExprGrouped(const ExprGrouped &N) {
+  if (llvm::Value *Dest = takeInPlaceAddr(N)) {
+    emitExprInto(*N.expr, Dest);
+    return Dest;
+  }
   return emitExprNode(*N.expr);
 }
 
@@ -756,20 +1674,32 @@ llvm::Value *CodeGen::emitExprArrayExpand(const ExprArrayExpand &N) {
   llvm::Type *ArrayTy =
       llvm::ArrayType::get(convertType(QTy->getElemType()), N.elements.size());
 
-  llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
-  llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
-                   TheFunction->getEntryBlock().begin());
-  llvm::AllocaInst *Alloca = TmpB.CreateAlloca(ArrayTy, nullptr, "arrayinit");
+  llvm::Value *Alloca = takeInPlaceAddr(N);
+  if (!Alloca) {
+    Alloca = createAlloca(ArrayTy, nullptr, "arrayinit");
+  }
 
-  for (size_t i = 0; i < N.elements.size(); ++i) {
-    llvm::Value *Val = emitExprNode(*N.elements[i]);
-    Val = getDerefValue(Val, N.elements[i]->getQualType());
-    assert(Val != nullptr);
+  if (llvm::Constant *Init = getConstant(N)) {
+    createConstantInit(Alloca, Init);
+    return Alloca;
+  }
 
+  for (size_t i = 0; i < N.elements.size(); ++i) {
     std::vector<llvm::Value *> IdxList;
     IdxList.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(Context), 0));
     IdxList.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(Context), i));
 
+    const QualType *ElemQTy = N.elements[i]->getQualType();
+    if (ElemQTy->isStruct() || ElemQTy->isArray()) {
+      llvm::Value *ElemPtr = Builder.CreateGEP(ArrayTy, Alloca, IdxList, "elemptr");
+      emitExprInto(*N.elements[i], ElemPtr);
+      continue;
+    }
+
+    llvm::Value *Val = emitExprNode(*N.elements[i]);
+    Val = getDerefValue(Val, ElemQTy);
+    assert(Val != nullptr);
+
     llvm::Value *ElemPtr = Builder.CreateGEP(ArrayTy, Alloca, IdxList, "elemptr");
     Builder.CreateStore(Val, ElemPtr);
   }
@@ -785,13 +1715,45 @@ llvm::Value *CodeGen::emitExprArrayAbbreviate(const ExprArrayAbbreviate &N) {
   llvm::Type *ArrayTy = convertType(QTy);
 
   llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
-  llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
-                   TheFunction->getEntryBlock().begin());
-  llvm::AllocaInst *Alloca = TmpB.CreateAlloca(ArrayTy, nullptr, "arrayinit");
-  llvm::Value *InitVal = getValue(emitExprNode(*N.value), N.value->getQualType());
+  llvm::Value *Alloca = takeInPlaceAddr(N);
+  if (!Alloca) {
+    Alloca = createAlloca(ArrayTy, nullptr, "arrayinit");
+  }
+
+  const llvm::DataLayout &DL = Module.getDataLayout();
+  llvm::Type *ElemTy = convertType(QTy->getElemType());
+  uint64_t Length = QTy->getLength();
+
+  // zero & byte splats become a memset, other constants a constant pool copy
+  llvm::Constant *InitC = getConstant(*N.value);
+  llvm::Value *Byte = InitC ? llvm::isBytewiseValue(InitC, DL) : nullptr;
+  if (Byte && llvm::isa<llvm::ConstantInt>(Byte)) {
+    Builder.CreateMemSet(Alloca, Byte, DL.getTypeAllocSize(ArrayTy),
+                         DL.getABITypeAlign(ArrayTy));
+    return Alloca;
+  }
+  if (llvm::Constant *Init = InitC ? getConstant(N) : nullptr) {
+    createConstantInit(Alloca, Init);
+    return Alloca;
+  }
+
+  llvm::Value *InitVal =
+      InitC ? InitC : getValue(emitExprNode(*N.value), N.value->getQualType());
+
+  // store a splat vector of several integer elements per iteration
+  uint64_t Step = 1;
+  llvm::Value *StoreVal = InitVal;
+  if (ElemTy->isIntegerTy() && ElemTy->getIntegerBitWidth() % 8 == 0) {
+    uint64_t Width = VectorStoreSize / DL.getTypeAllocSize(ElemTy);
+    if (Width > 1 && Length >= Width) {
+      Step = Width;
+      StoreVal = Builder.CreateVectorSplat(Width, InitVal, "splat");
+    }
+  }
+  llvm::Align ElemAlign = DL.getABITypeAlign(ElemTy);
 
   llvm::Type *Int32Ty = llvm::Type::getInt32Ty(Context);
-  llvm::Value *ArraySize = llvm::ConstantInt::get(Int32Ty, QTy->getLength());
+  llvm::Value *ArraySize = llvm::ConstantInt::get(Int32Ty, Length / Step * Step);
 
   // create a loop to init array
   llvm::BasicBlock *CurBB = Builder.GetInsertBlock();
@@ -809,6 +1771,8 @@ llvm::Value *CodeGen::emitExprArrayAbbreviate(const ExprArrayAbbreviate &N) {
   IndexPhi->addIncoming(LoopIndex, CurBB);
   llvm::Value *Cond = Builder.CreateICmpULT(IndexPhi, ArraySize, "cond");
   Builder.CreateCondBr(Cond, LoopBody, LoopExit);
+  SSA.seal(LoopBody);
+  SSA.seal(LoopExit);
 
   // loop body
   Builder.SetInsertPoint(LoopBody);
@@ -816,14 +1780,21 @@ llvm::Value *CodeGen::emitExprArrayAbbreviate(const ExprArrayAbbreviate &N) {
   std::vector<llvm::Value *> GEPIndices = {
       llvm::ConstantInt::get(llvm::Type::getInt64Ty(Context), 0), IndexPhi};
   llvm::Value *ElemAddr = Builder.CreateGEP(ArrayTy, Alloca, GEPIndices);
-  Builder.CreateStore(InitVal, ElemAddr);
+  Builder.CreateAlignedStore(StoreVal, ElemAddr, ElemAlign);
 
-  llvm::Value *NextIndex = Builder.CreateAdd(IndexPhi, llvm::ConstantInt::get(Int32Ty, 1));
+  llvm::Value *NextIndex = Builder.CreateAdd(IndexPhi, llvm::ConstantInt::get(Int32Ty, Step));
 
   Builder.CreateBr(LoopHeader);
   IndexPhi->addIncoming(NextIndex, LoopBody);
+  SSA.seal(LoopHeader);
 
   Builder.SetInsertPoint(LoopExit);
+
+  // the elements left over by the vector loop
+  for (uint64_t Idx = Length / Step * Step; Idx < Length; ++Idx) {
+    llvm::Value *Addr = Builder.CreateConstGEP2_64(ArrayTy, Alloca, 0, Idx);
+    Builder.CreateAlignedStore(InitVal, Addr, ElemAlign);
+  }
   return Alloca;
 }
 
@@ -834,6 +1805,8 @@ llvm::Value *CodeGen::emitExprIndex(const ExprIndex &N) {
     BaseV = Builder.CreateLoad(convertType(N.array->getQualType()), BaseV);
   }
   llvm::Value *IdxV = getValue(emitExprNode(*N.index), N.index->getQualType());
+  // GEP sign-extends its indices, a u32 index is widened here first
+  IdxV = castInt(IdxV, N.index->getQualType(), Module.getDataLayout().getIntPtrType(Context));
   std::vector<llvm::Value *> IdxList;
   IdxList.push_back(llvm::ConstantInt::get(llvm::Type::getInt32Ty(Context), 0));
   IdxList.push_back(IdxV);
@@ -848,6 +1821,9 @@ llvm::Value *CodeGen::emitExprIndex(const ExprIndex &N) {
   if (QTy == nullptr) {
     throw std::runtime_error("not array type for array index expr");
   }
+  if (BoundsChecks) {
+    emitBoundsCheck(IdxV, QTy->getLength());
+  }
   llvm::Type *ArrayTy = convertType(QTy);
   llvm::Value *ElemPtr = Builder.CreateGEP(ArrayTy, BaseV, IdxList, "elemptr");
 
@@ -859,32 +1835,44 @@ llvm::Value *CodeGen::emitExprStruct(const ExprStruct &N) {
 
   llvm::StructType *Ty = StructTyDef[QTy->getName()];
 
-  llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
-  llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
-                   TheFunction->getEntryBlock().begin());
-  llvm::AllocaInst *Alloca = TmpB.CreateAlloca(Ty, nullptr, "structinit");
+  llvm::Value *Alloca = takeInPlaceAddr(N);
+  if (!Alloca) {
+    Alloca = createAlloca(Ty, nullptr, "structinit");
+  }
 
   for (auto &Field : N.fields) {
     const std::string &FieldName = Field.identifier;
-    llvm::Value *FieldVal = emitExprNode(*Field.expr);
-    assert(FieldVal != nullptr);
-
-    int Idx = QTy->getFieldIndex(FieldName);
-    assert(Idx >= 0);
+    unsigned Idx = getFieldSlot(QTy, FieldName);
 
-    llvm::Value *FieldPtr = Builder.CreateStructGEP(Ty, Alloca, Idx);
     const QualType *FieldTy = QTy->getFieldType(FieldName);
     if (FieldTy->isArray() || FieldTy->isStruct()) {
-      createMemCpy(FieldPtr, FieldVal, convertType(FieldTy));
-    } else {
-      FieldVal = getValue(FieldVal, QTy->getFieldType(FieldName));
-      Builder.CreateStore(FieldVal, FieldPtr);
+      emitExprInto(*Field.expr, Builder.CreateStructGEP(Ty, Alloca, Idx));
+      continue;
     }
+    llvm::Value *FieldVal = emitExprNode(*Field.expr);
+    assert(FieldVal != nullptr);
+
+    llvm::Value *FieldPtr = Builder.CreateStructGEP(Ty, Alloca, Idx);
+    FieldVal = getValue(FieldVal, Field.expr->getQualType());
+    Builder.CreateStore(castInt(FieldVal, Field.expr->getQualType(), convertType(FieldTy)),
+                        FieldPtr);
   }
   return Alloca;
 }
 
+llvm::Value *CodeGen::emitArg(const ExprNode &Arg, const QualType *ParamTy) {
+  if (isIndirectParam(Arg.getQualType())) {
+    // temporaries are built right in the copy handed to the callee
+    llvm::Value *Tmp = createAlloca(convertType(Arg.getQualType()), nullptr, "argtmp");
+    emitExprInto(Arg, Tmp);
+    return Tmp;
+  }
+  llvm::Value *V = getValue(emitExprNode(Arg), Arg.getQualType());
+  return castInt(V, Arg.getQualType(), convertType(ParamTy));
+}
+
 llvm::Value *CodeGen::emitExprCall(const ExprCall &N) {
+  llvm::Value *Dest = takeInPlaceAddr(N); // before arguments reset it
   const FuncQualType *FnTy = dynamic_cast<const FuncQualType*>(N.expr->getQualType());
   assert(FnTy != nullptr);
 
@@ -896,25 +1884,121 @@ llvm::Value *CodeGen::emitExprCall(const ExprCall &N) {
   assert(Fn != nullptr);
 
   std::vector<llvm::Value *> ArgsV;
-  for (auto &Arg : N.params) {
-    llvm::Value *ArgV = emitExprNode(*Arg);
-    ArgV = getValue(ArgV, Arg->getQualType());
-    ArgsV.push_back(ArgV);
+  for (size_t Idx = 0; Idx < N.params.size(); Idx++) {
+    ArgsV.push_back(emitArg(*N.params[Idx], FnTy->getParamTypes()[Idx]));
   }
 
-  if (FnTy->getReturnType()->isArray() || FnTy->getReturnType()->isStruct()) {
+  bool Sret = FnTy->getReturnType()->isArray() || FnTy->getReturnType()->isStruct();
+  // an aggregate is only the result if it is built in the caller's slot
+  bool Tail = TailCalls.count(&N) && (!Sret || (Dest && Dest == ReturnValue));
+  if (Tail && TailRecurseBB && Fn == TailRecurseBB->getParent() &&
+      emitTailRecursion(ArgsV)) {
+    if (Sret) {
+      return Dest;
+    }
+    return Fn->getReturnType()->isVoidTy() ? nullptr
+                                           : llvm::PoisonValue::get(Fn->getReturnType());
+  }
+
+  if (Sret) {
     llvm::Type *RetTy = convertType(FnTy->getReturnType());
-    llvm::AllocaInst *Alloca = createAlloca(RetTy, nullptr, "rettmp");
-    ArgsV.push_back(Alloca);
+    llvm::Value *Alloca = Dest ? Dest : createAlloca(RetTy, nullptr, "rettmp");
+    ArgsV.insert(ArgsV.begin(), Alloca);
 
-    Builder.CreateCall(Fn, ArgsV, "");
+    llvm::CallInst *Call = Builder.CreateCall(Fn, ArgsV, "");
+    Call->addParamAttr(0, llvm::Attribute::getWithStructRetType(Context, RetTy));
+    if (Tail) {
+      emitTailCall(Call);
+    }
     return Alloca;
   }
 
-  return Builder.CreateCall(Fn, ArgsV, "");
+  llvm::CallInst *Call = Builder.CreateCall(Fn, ArgsV, "");
+  if (Tail) {
+    emitTailCall(Call);
+  }
+  return Call;
+}
+
+bool CodeGen::emitTailRecursion(const std::vector<llvm::Value *> &Args) {
+  llvm::Function *Fn = TailRecurseBB->getParent();
+  std::vector<const QualType *> ParamTys = CurrentFn->getQualType()->getParamTypes();
+  const std::vector<FnParam> &Params = CurrentFn->function_parameters.fn_params;
+  unsigned ArgBase = Fn->hasStructRetAttr() ? 1 : 0;
+  for (size_t Idx = 0; Idx < Args.size(); Idx++) {
+    if (isIndirectParam(ParamTys[Idx])) {
+      continue; // a copy of our own, moved into the parameter below
+    }
+    if (!isFrameIndependent(Args[Idx])) {
+      return false;
+    }
+    // a parameter passed by pointer is about to be overwritten
+    auto *Arg = llvm::dyn_cast<llvm::Argument>(llvm::getUnderlyingObject(Args[Idx]));
+    if (Args[Idx]->getType()->isPointerTy() && Arg && Arg->getArgNo() >= ArgBase &&
+        isIndirectParam(ParamTys[Arg->getArgNo() - ArgBase])) {
+      return false;
+    }
+  }
+
+  // every argument is evaluated before any parameter changes
+  for (size_t Idx = 0; Idx < Args.size(); Idx++) {
+    const std::string &Name =
+        static_cast<const PatternIdentifier *>(Params[Idx].pattern.get())->identifier;
+    if (isIndirectParam(ParamTys[Idx])) {
+      createMemCpy(AllocaAddr[Name], Args[Idx], convertType(ParamTys[Idx]));
+    } else if (SSA.contains(Name)) {
+      SSA.write(Name, Builder.GetInsertBlock(), Args[Idx]);
+    } else {
+      Builder.CreateStore(Args[Idx], AllocaAddr[Name]);
+    }
+  }
+  Builder.CreateBr(TailRecurseBB);
+
+  llvm::BasicBlock *DEAD = llvm::BasicBlock::Create(Context, "dead", Fn);
+  SSA.seal(DEAD); // nothing branches here
+  Builder.SetInsertPoint(DEAD);
+  return true;
+}
+
+void CodeGen::emitTailCall(llvm::CallInst *Call) {
+  for (llvm::Value *Arg : Call->args()) {
+    if (!isFrameIndependent(Arg)) {
+      return;
+    }
+  }
+  llvm::Function *Caller = Call->getFunction();
+  if (Call->getFunctionType() != Caller->getFunctionType()) {
+    Call->setTailCall();
+    return;
+  }
+  // the callee can take over the caller's frame for sure
+  Call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+  if (Call->getType()->isVoidTy()) {
+    Builder.CreateRetVoid();
+  } else {
+    Builder.CreateRet(Call);
+  }
+
+  llvm::BasicBlock *DEAD = llvm::BasicBlock::Create(Context, "dead", Caller);
+  SSA.seal(DEAD); // nothing branches here
+  Builder.SetInsertPoint(DEAD);
+}
+
+bool CodeGen::isFrameIndependent(const llvm::Value *V) const {
+  if (!V->getType()->isPointerTy()) {
+    return true;
+  }
+  const llvm::Value *Obj = llvm::getUnderlyingObject(V);
+  if (llvm::isa<llvm::Argument>(Obj) || llvm::isa<llvm::Constant>(Obj)) {
+    return true;
+  }
+  // a reference parameter holds what the caller handed over
+  auto *Load = llvm::dyn_cast<llvm::LoadInst>(Obj);
+  return Load && ParamSlots.count(Load->getPointerOperand());
 }
 
 llvm::Value *CodeGen::emitExprMethodCall(const ExprMethodCall &N) {
+  llvm::Value *Dest = takeInPlaceAddr(N); // before arguments reset it
   llvm::Value *SelfV = emitExprNode(*N.expr);
   const QualType *Ty = N.expr->getQualType();
 
@@ -926,7 +2010,7 @@ llvm::Value *CodeGen::emitExprMethodCall(const ExprMethodCall &N) {
 
   if (const ArrayQualType *ATy = dynamic_cast<const ArrayQualType*>(Ty)) {
     assert(N.path->identifier == "len");
-    return llvm::ConstantInt::get(llvm::Type::getInt32Ty(Context), ATy->getLength());
+    return llvm::ConstantInt::get(convertType(N.getQualType()), ATy->getLength());
   }
 
   const StructQualType *STy = dynamic_cast<const StructQualType*>(Ty);
@@ -940,26 +2024,36 @@ llvm::Value *CodeGen::emitExprMethodCall(const ExprMethodCall &N) {
   assert(CalleeF != nullptr && "method not found");
 
   std::vector<llvm::Value *> ArgsV;
-  if (!FnTy->getParamTypes()[0]->isPointer()) { // pass as self value
+  if (isIndirectParam(FnTy->getParamTypes()[0])) {
+    // the callee owns its self, hand it a copy
+    llvm::Value *Tmp = createAlloca(convertType(STy), nullptr, "selftmp");
+    createMemCpy(Tmp, SelfV, convertType(STy));
+    SelfV = Tmp;
+  } else if (!FnTy->getParamTypes()[0]->isPointer()) { // pass as self value
     SelfV = Builder.CreateLoad(convertType(STy), SelfV);
   }
   ArgsV.push_back(SelfV);
 
-  for (auto &Arg : N.params) {
-    llvm::Value *ArgV = emitExprNode(*Arg);
-    ArgV = getValue(ArgV, Arg->getQualType());
-    ArgsV.push_back(ArgV);
+  for (size_t Idx = 0; Idx < N.params.size(); Idx++) {
+    ArgsV.push_back(emitArg(*N.params[Idx], FnTy->getParamTypes()[Idx + 1]));
   }
 
   if (FnTy->getReturnType()->isArray() || FnTy->getReturnType()->isStruct()) {
-    llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
     llvm::Type *RetTy = convertType(FnTy->getReturnType());
-    llvm::AllocaInst *Alloca = createAlloca(RetTy, nullptr, "rettmp");
-    ArgsV.push_back(Alloca);
-    Builder.CreateCall(CalleeF, ArgsV);
+    llvm::Value *Alloca = Dest ? Dest : createAlloca(RetTy, nullptr, "rettmp");
+    ArgsV.insert(ArgsV.begin(), Alloca);
+    llvm::CallInst *Call = Builder.CreateCall(CalleeF, ArgsV);
+    Call->addParamAttr(0, llvm::Attribute::getWithStructRetType(Context, RetTy));
+    if (TailCalls.count(&N) && Dest && Dest == ReturnValue) {
+      emitTailCall(Call);
+    }
     return Alloca;
   }
-  return Builder.CreateCall(CalleeF, ArgsV);
+  llvm::CallInst *Call = Builder.CreateCall(CalleeF, ArgsV);
+  if (TailCalls.count(&N)) {
+    emitTailCall(Call);
+  }
+  return Call;
 }
 
 llvm::Value *CodeGen::emitExprField(const ExprField &N) {
@@ -973,49 +2067,57 @@ llvm::Value *CodeGen::emitExprField(const ExprField &N) {
   const StructQualType *ST = dynamic_cast<const StructQualType*>(AddrQTy);
   assert(ST != nullptr);
 
-  size_t Idx = ST->getFieldIndex(N.identifier);
-  return Builder.CreateStructGEP(convertType(ST), Addr, Idx);
+  return Builder.CreateStructGEP(convertType(ST), Addr, getFieldSlot(ST, N.identifier));
 }
 
 llvm::Value *CodeGen::emitExprLoopInfinite(const ExprLoopInfinite &N) {
   llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
   llvm::BasicBlock *LoopBB = llvm::BasicBlock::Create(Context, "loop", TheFunction);
+  // placed after the body once it is known to be reached
+  llvm::BasicBlock *LatchBB = llvm::BasicBlock::Create(Context, "loop.latch");
   llvm::BasicBlock *AfterBB = llvm::BasicBlock::Create(Context, "afterloop", TheFunction);
 
   // Save previous loop state
-  llvm::BasicBlock *SavedHeadBB = CurrentHeadBB;
+  llvm::BasicBlock *SavedLatchBB = CurrentLatchBB;
   llvm::BasicBlock *SavedAfterBB = CurrentAfterBB;
   llvm::Value *SavedLoopRes = CurrentLoopRes;
+  auto *SavedLoopBreaks = CurrentLoopBreaks;
+
+  llvm::Type *Ty = convertType(N.getQualType());
+  // a scalar result is a phi of the break values
+  std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> Breaks;
+  CurrentLoopRes = nullptr;
+  CurrentLoopBreaks = nullptr;
+  if (Ty->isIntegerTy()) {
+    CurrentLoopBreaks = &Breaks;
+  } else if (!Ty->isVoidTy()) {
+    CurrentLoopRes = createAlloca(Ty, nullptr, "loopres");
+  }
 
+  // the current block becomes the preheader
   Builder.CreateBr(LoopBB);
   Builder.SetInsertPoint(LoopBB);
-  CurrentHeadBB = LoopBB;
+  CurrentLatchBB = LatchBB;
   CurrentAfterBB = AfterBB;
 
-  llvm::Type *Ty = convertType(N.getQualType());
-  llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
-                   TheFunction->getEntryBlock().begin());
-  llvm::AllocaInst *Alloca1 = nullptr;
-  if (Ty->isVoidTy()) {
-    CurrentLoopRes = nullptr;
-  } else {
-    Alloca1 = TmpB.CreateAlloca(Ty, nullptr, "iftmp");
-
-    CurrentLoopRes = TmpB.CreateAlloca(Ty, nullptr, "loopres");
-  }
-
   emitExprBlock(*N.block);
 
   if (!Builder.GetInsertBlock()->getTerminator())
-    Builder.CreateBr(LoopBB);
+    Builder.CreateBr(LatchBB);
+  emitLoopLatch(LatchBB, LoopBB);
+  SSA.seal(AfterBB);
 
   Builder.SetInsertPoint(AfterBB);
+  llvm::Value *RetVal = CurrentLoopRes;
+  if (CurrentLoopBreaks) {
+    RetVal = createMergePhi(Ty, Breaks, "loopres");
+  }
 
   // Restore state
-  CurrentHeadBB = SavedHeadBB;
+  CurrentLatchBB = SavedLatchBB;
   CurrentAfterBB = SavedAfterBB;
-  llvm::Value *RetVal = CurrentLoopRes;
   CurrentLoopRes = SavedLoopRes;
+  CurrentLoopBreaks = SavedLoopBreaks;
 
   return RetVal;
 }
@@ -1027,25 +2129,29 @@ llvm::Value *CodeGen::emitExprLoopPredicate(const ExprLoopPredicate &N) {
   llvm::BasicBlock *HeaderBB =
       llvm::BasicBlock::Create(Context, "loop.header", TheFunction);
   llvm::BasicBlock *BodyBB = llvm::BasicBlock::Create(Context, "loop.body", TheFunction);
-  llvm::BasicBlock *LatchBB = llvm::BasicBlock::Create(Context, "loop.latch", TheFunction);
+  llvm::BasicBlock *LatchBB = llvm::BasicBlock::Create(Context, "loop.latch");
   llvm::BasicBlock *ExitBB = llvm::BasicBlock::Create(Context, "loop.exit", TheFunction);
 
-  // Setup result storage
-  llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
-                   TheFunction->getEntryBlock().begin());
-  llvm::Type *Ty = convertType(N.block->getQualType());
-
   // Save previous loop state
-  llvm::BasicBlock *SavedHeadBB = CurrentHeadBB;
+  llvm::BasicBlock *SavedLatchBB = CurrentLatchBB;
   llvm::BasicBlock *SavedAfterBB = CurrentAfterBB;
   llvm::Value *SavedLoopRes = CurrentLoopRes;
+  auto *SavedLoopBreaks = CurrentLoopBreaks;
 
-  CurrentHeadBB = HeaderBB;
+  // the loop's value is that of its breaks, the body's is dropped
+  llvm::Type *Ty = convertType(N.getQualType());
+  std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> Breaks;
+  CurrentLatchBB = LatchBB;
   CurrentAfterBB = ExitBB;
-  if (!Ty->isVoidTy())
-    CurrentLoopRes = TmpB.CreateAlloca(Ty, nullptr, "loop.res");
+  CurrentLoopRes = nullptr;
+  CurrentLoopBreaks = nullptr;
+  if (Ty->isIntegerTy()) {
+    CurrentLoopBreaks = &Breaks;
+  } else if (!Ty->isVoidTy()) {
+    CurrentLoopRes = createAlloca(Ty, nullptr, "loop.res");
+  }
 
-  // Entry -> Header
+  // Preheader -> Header
   Builder.CreateBr(HeaderBB);
 
   // Header: Check condition
@@ -1059,15 +2165,15 @@ llvm::Value *CodeGen::emitExprLoopPredicate(const ExprLoopPredicate &N) {
         CondV, llvm::ConstantInt::get(llvm::Type::getInt32Ty(Context), 0), "loop.cond");
   }
   Builder.CreateCondBr(CondV, BodyBB, ExitBB);
+  if (CurrentLoopBreaks) {
+    // leaving through the condition yields no value
+    Breaks.push_back({llvm::PoisonValue::get(Ty), Builder.GetInsertBlock()});
+  }
+  SSA.seal(BodyBB);
 
   // Body
   Builder.SetInsertPoint(BodyBB);
-
-  llvm::Value *body = emitExprBlock(*N.block);
-  if (!N.block->getQualType()->isVoid())
-    body = getValue(body, N.block->getQualType());
-  if (body && !Ty->isVoidTy())
-    Builder.CreateStore(body, CurrentLoopRes);
+  emitExprBlock(*N.block);
 
   // If not terminated (break/return), jump to Latch
   if (!Builder.GetInsertBlock()->getTerminator()) {
@@ -1075,40 +2181,188 @@ llvm::Value *CodeGen::emitExprLoopPredicate(const ExprLoopPredicate &N) {
   }
 
   // Latch: Jump back to Header
-  Builder.SetInsertPoint(LatchBB);
-  Builder.CreateBr(HeaderBB);
+  emitLoopLatch(LatchBB, HeaderBB);
+  SSA.seal(ExitBB);
 
   // Exit
   Builder.SetInsertPoint(ExitBB);
-
-  // Load result (if break with value was used)
-  llvm::Value *Result = nullptr;
-  if (!Ty->isVoidTy())
-    Result = Builder.CreateLoad(Ty, CurrentLoopRes, "loop.result");
+  llvm::Value *Result = CurrentLoopRes;
+  if (CurrentLoopBreaks) {
+    Result = createMergePhi(Ty, Breaks, "loop.result");
+  }
 
   // Restore state
-  CurrentHeadBB = SavedHeadBB;
+  CurrentLatchBB = SavedLatchBB;
   CurrentAfterBB = SavedAfterBB;
   CurrentLoopRes = SavedLoopRes;
+  CurrentLoopBreaks = SavedLoopBreaks;
 
   return Result;
 }
 
+void CodeGen::emitLoopLatch(llvm::BasicBlock *LatchBB, llvm::BasicBlock *HeaderBB) {
+  if (llvm::pred_empty(LatchBB)) {
+    // every path through the body breaks or returns
+    delete LatchBB;
+    SSA.seal(HeaderBB);
+    return;
+  }
+  LatchBB->insertInto(HeaderBB->getParent());
+  SSA.seal(LatchBB);
+  Builder.SetInsertPoint(LatchBB);
+  llvm::BranchInst *Br = Builder.CreateBr(HeaderBB);
+  SSA.seal(HeaderBB);
+
+  // the loop id is a distinct node listing itself first
+  llvm::SmallVector<llvm::Metadata *, 4> Ops = {nullptr};
+  if (VectorizeLoops) {
+    Ops.push_back(llvm::MDNode::get(
+        Context, {llvm::MDString::get(Context, "llvm.loop.vectorize.enable"),
+                  llvm::ConstantAsMetadata::get(Builder.getTrue())}));
+  }
+  if (UnrollLoops) {
+    Ops.push_back(llvm::MDNode::get(Context, llvm::MDString::get(Context, "llvm.loop.unroll.enable")));
+  }
+  if (Ops.size() > 1) {
+    llvm::MDNode *LoopID = llvm::MDNode::getDistinct(Context, Ops);
+    LoopID->replaceOperandWith(0, LoopID);
+    Br->setMetadata(llvm::LLVMContext::MD_loop, LoopID);
+  }
+}
+
 llvm::Value *CodeGen::emitExprBreak(const ExprBreak &N) {
   llvm::Value *V = nullptr;
   if (N.expr) {
     V = getValue(emitExprNode(*N.expr), N.getQualType());
-    Builder.CreateStore(V, CurrentLoopRes);
+    if (CurrentLoopBreaks) {
+      CurrentLoopBreaks->push_back({V, Builder.GetInsertBlock()});
+    } else {
+      // a break before the one that settled the loop's type may be narrower
+      V = castInt(V, N.getQualType(),
+                  llvm::cast<llvm::AllocaInst>(CurrentLoopRes)->getAllocatedType());
+      Builder.CreateStore(V, CurrentLoopRes);
+    }
   }
   Builder.CreateBr(CurrentAfterBB);
   return V;
 }
 
 llvm::Value *CodeGen::emitExprContinue(const ExprContinue &N) {
-  return Builder.CreateBr(CurrentHeadBB);
+  return Builder.CreateBr(CurrentLatchBB);
+}
+
+bool CodeGen::isCaseLabel(const ExprNode &N) const {
+  const ExprNode *E = stripGrouped(&N);
+  switch (E->getTypeID()) {
+  default:
+    return false;
+  case ASTNode::K_ExprLiteralInt:
+  case ASTNode::K_ExprLiteralChar:
+  case ASTNode::K_ExprLiteralBool:
+    return true;
+  case ASTNode::K_ExprPath: {
+    // an enum variant or a const item
+    auto *P = static_cast<const ExprPath *>(E);
+    return P->path2 || Syms.constTable.count(P->path1->identifier);
+  }
+  case ASTNode::K_ExprOpUnary:
+    return static_cast<const ExprOpUnary *>(E)->type == NEGATE_ &&
+           isCaseLabel(*static_cast<const ExprOpUnary *>(E)->expr);
+  case ASTNode::K_ExprOpCast:
+    return isCaseLabel(*static_cast<const ExprOpCast *>(E)->expr);
+  }
+}
+
+// whether A and B read the same place, without side effects
+static bool isSameScrutinee(const ExprNode &A, const ExprNode &B) {
+  const ExprNode *L = stripGrouped(&A), *R = stripGrouped(&B);
+  if (L->getTypeID() != R->getTypeID()) {
+    return false;
+  }
+  switch (L->getTypeID()) {
+  default:
+    return false;
+  case ASTNode::K_ExprPath: {
+    auto *P = static_cast<const ExprPath *>(L), *Q = static_cast<const ExprPath *>(R);
+    return !P->path2 && !Q->path2 && P->path1->type == PathType::Identifier &&
+           Q->path1->type == PathType::Identifier &&
+           P->path1->identifier == Q->path1->identifier;
+  }
+  case ASTNode::K_ExprField: {
+    auto *F = static_cast<const ExprField *>(L), *G = static_cast<const ExprField *>(R);
+    return F->identifier == G->identifier && isSameScrutinee(*F->expr, *G->expr);
+  }
+  case ASTNode::K_ExprOpUnary: {
+    auto *U = static_cast<const ExprOpUnary *>(L), *V = static_cast<const ExprOpUnary *>(R);
+    return U->type == DEREFERENCE_ && V->type == DEREFERENCE_ &&
+           isSameScrutinee(*U->expr, *V->expr);
+  }
+  }
+}
+
+const ExprNode *CodeGen::matchSwitchChain(const ExprIf &N, std::vector<SwitchCase> &Cases,
+                                          const ExprNode *&Default) {
+  const ExprNode *Scrutinee = nullptr;
+  Default = nullptr;
+  std::unordered_set<llvm::ConstantInt *> Seen;
+  for (const ExprIf *If = &N; If; If = dynamic_cast<const ExprIf *>(If->else_block.get())) {
+    auto *Cmp = dynamic_cast<const ExprOpBinary *>(stripGrouped(If->condition.get()));
+    if (!Cmp || Cmp->type != EQUAL_) {
+      break;
+    }
+    const ExprNode *Operand = Cmp->left.get();
+    const ExprNode *Label = Cmp->right.get();
+    if (isCaseLabel(*Operand)) {
+      std::swap(Operand, Label);
+    }
+    if (!isCaseLabel(*Label) || !isSameScrutinee(Scrutinee ? *Scrutinee : *Operand, *Operand)) {
+      break;
+    }
+    auto *C = llvm::dyn_cast_or_null<llvm::ConstantInt>(getConstant(*Label));
+    if (!C || C->getType() != convertType(Operand->getQualType())) {
+      break;
+    }
+    Scrutinee = Operand;
+    // a repeated value was taken by an earlier branch, this one is dead
+    if (Seen.insert(C).second) {
+      Cases.push_back({C, If});
+    }
+    Default = If->else_block.get();
+  }
+  if (Cases.size() < MinSwitchCases) {
+    Cases.clear();
+    return nullptr;
+  }
+  return Scrutinee;
+}
+
+void CodeGen::emitBranchArm(
+    const ExprNode &Arm, llvm::AllocaInst *Slot, llvm::Type *Ty,
+    std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> &Results,
+    llvm::BasicBlock *MergeBB) {
+  llvm::Value *V = emitExprNode(Arm);
+  if (Builder.GetInsertBlock()->getTerminator()) {
+    return;
+  }
+  if (Arm.getQualType()->isVoid()) {
+    V = nullptr;
+  } else if (V) {
+    V = getValue(V, Arm.getQualType());
+    if (Slot)
+      Builder.CreateStore(V, Slot);
+  }
+  if (Ty && !Slot)
+    Results.push_back({V ? V : llvm::PoisonValue::get(Ty), Builder.GetInsertBlock()});
+  Builder.CreateBr(MergeBB);
 }
 
 llvm::Value *CodeGen::emitExprIf(const ExprIf &N) {
+  std::vector<SwitchCase> Cases;
+  const ExprNode *Default;
+  if (const ExprNode *Scrutinee = matchSwitchChain(N, Cases, Default)) {
+    return emitSwitchChain(N, *Scrutinee, Cases, Default);
+  }
+
   llvm::Value *CondV =
       getValue(emitExprNode(*N.condition), N.condition->getQualType());
   llvm::Type *Ty = nullptr;
@@ -1116,12 +2370,12 @@ llvm::Value *CodeGen::emitExprIf(const ExprIf &N) {
     Ty = convertType(N.getQualType());
   }
   llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
-  llvm::IRBuilder<> TmpB(&TheFunction->getEntryBlock(),
-                   TheFunction->getEntryBlock().begin());
 
+  // a scalar result is a phi in the merge block, others go through memory
   llvm::AllocaInst *Alloca1 = nullptr;
-  if (Ty)
-    Alloca1 = TmpB.CreateAlloca(Ty, nullptr, "iftmp");
+  std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> Results;
+  if (Ty && !Ty->isIntegerTy())
+    Alloca1 = createAlloca(Ty, nullptr, "iftmp");
 
   if (!CondV)
     return nullptr;
@@ -1141,38 +2395,72 @@ llvm::Value *CodeGen::emitExprIf(const ExprIf &N) {
   }
 
   Builder.CreateCondBr(CondV, ThenBB, hasElse ? ElseBB : MergeBB);
+  SSA.seal(ThenBB);
+  if (hasElse)
+    SSA.seal(ElseBB);
 
   Builder.SetInsertPoint(ThenBB);
+  emitBranchArm(*N.if_block, Alloca1, Ty, Results, MergeBB);
 
-  llvm::Value *ThenV = emitExprBlock(*N.if_block);
+  if (hasElse) {
+    Builder.SetInsertPoint(ElseBB);
+    emitBranchArm(*N.else_block, Alloca1, Ty, Results, MergeBB);
+  }
+  SSA.seal(MergeBB);
 
-  ThenBB = Builder.GetInsertBlock();
+  Builder.SetInsertPoint(MergeBB);
+  if (Ty && !Alloca1) {
+    return createMergePhi(Ty, Results, "iftmp");
+  }
 
-  if (!Builder.GetInsertBlock()->getTerminator()) {
-    if (ThenV) {
-      ThenV = getValue(ThenV, N.if_block->getQualType());
-      Builder.CreateStore(ThenV, Alloca1);
-    }
-    Builder.CreateBr(MergeBB);
+  return Alloca1;
+}
+
+llvm::Value *CodeGen::emitSwitchChain(const ExprIf &N, const ExprNode &Scrutinee,
+                                      const std::vector<SwitchCase> &Cases,
+                                      const ExprNode *Default) {
+  // evaluated once, where the chain would compare it again and again
+  llvm::Value *V = getValue(emitExprNode(Scrutinee), Scrutinee.getQualType());
+  llvm::Type *Ty = nullptr;
+  if (!N.getQualType()->isVoid()) {
+    Ty = convertType(N.getQualType());
   }
+  llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
 
-  llvm::Value *ElseV = nullptr;
-  if (hasElse) {
-    Builder.SetInsertPoint(ElseBB);
-    ElseV = emitExprNode(*N.else_block);
-    if (ElseV && N.else_block->getQualType()->isVoid() == false) {
-      ElseV = getValue(ElseV, N.else_block->getQualType());
-      Builder.CreateStore(ElseV, Alloca1);
-    }
+  llvm::AllocaInst *Slot = nullptr;
+  std::vector<std::pair<llvm::Value *, llvm::BasicBlock *>> Results;
+  if (Ty && !Ty->isIntegerTy())
+    Slot = createAlloca(Ty, nullptr, "iftmp");
+
+  llvm::BasicBlock *MergeBB = llvm::BasicBlock::Create(Context, "ifcont", TheFunction);
+  llvm::BasicBlock *DefaultBB =
+      Default ? llvm::BasicBlock::Create(Context, "else", TheFunction) : MergeBB;
+  llvm::SwitchInst *Switch = Builder.CreateSwitch(V, DefaultBB, Cases.size());
+  std::vector<llvm::BasicBlock *> CaseBBs;
+  for (const SwitchCase &Case : Cases) {
+    llvm::BasicBlock *BB = llvm::BasicBlock::Create(Context, "then", TheFunction);
+    Switch->addCase(Case.first, BB);
+    SSA.seal(BB);
+    CaseBBs.push_back(BB);
+  }
+  if (Default)
+    SSA.seal(DefaultBB);
 
-    if (!Builder.GetInsertBlock()->getTerminator())
-      Builder.CreateBr(MergeBB);
-    ElseBB = Builder.GetInsertBlock();
+  for (size_t I = 0; I < Cases.size(); ++I) {
+    Builder.SetInsertPoint(CaseBBs[I]);
+    emitBranchArm(*Cases[I].second->if_block, Slot, Ty, Results, MergeBB);
   }
+  if (Default) {
+    Builder.SetInsertPoint(DefaultBB);
+    emitBranchArm(*Default, Slot, Ty, Results, MergeBB);
+  }
+  SSA.seal(MergeBB);
 
   Builder.SetInsertPoint(MergeBB);
-
-  return Alloca1;
+  if (Ty && !Slot) {
+    return createMergePhi(Ty, Results, "iftmp");
+  }
+  return Slot;
 }
 
 llvm::Value *CodeGen::emitExprReturn(const ExprReturn &N) {
@@ -1181,20 +2469,23 @@ llvm::Value *CodeGen::emitExprReturn(const ExprReturn &N) {
     return nullptr;
   }
 
-  llvm::Value *V = emitExprNode(*N.expr);
   llvm::Value *RV = nullptr;
   const QualType *Ty = N.expr->getQualType();
   if (Ty->isStruct() || Ty->isArray()) {
-    createMemCpy(ReturnValue, V, convertType(Ty));
+    emitExprInto(*N.expr, ReturnValue);
   } else {
-    RV = getValue(V, N.expr->getQualType());
-    Builder.CreateStore(RV, ReturnValue);
+    RV = getValue(emitExprNode(*N.expr), N.expr->getQualType());
+    if (auto *RetPhi = llvm::dyn_cast_or_null<llvm::PHINode>(ReturnValue)) {
+      RV = castInt(RV, N.expr->getQualType(), RetPhi->getType());
+      RetPhi->addIncoming(RV, Builder.GetInsertBlock());
+    }
   }
 
   Builder.CreateBr(Exit);
   llvm::Function *TheFunction = Builder.GetInsertBlock()->getParent();
 
   llvm::BasicBlock *DEAD = llvm::BasicBlock::Create(Context, "dead", TheFunction);
+  SSA.seal(DEAD); // nothing branches here
   Builder.SetInsertPoint(DEAD);
   return RV;
 }
@@ -1225,15 +2516,16 @@ llvm::Type *CodeGen::getPathType(const TypePath &N) {
     if (I != StructTyDef.end()) {
       return I->second;
     }
-    auto I1 = const_cast<SymTable &>(Syms).enumTable.getTy(N.path->identifier);
+    auto I1 = Syms.enumTable.getTy(N.path->identifier);
     if (I1 != nullptr) {
       return llvm::Type::getInt32Ty(Context);
     }
 
     llvm::Type *Ty = nullptr;
-    if (N.path->identifier == "i32" || N.path->identifier == "u32" ||
-        N.path->identifier == "usize" || N.path->identifier == "isize") {
+    if (N.path->identifier == "i32" || N.path->identifier == "u32") {
       Ty = llvm::Type::getInt32Ty(Context);
+    } else if (N.path->identifier == "usize" || N.path->identifier == "isize") {
+      Ty = Module.getDataLayout().getIntPtrType(Context);
     } else if (N.path->identifier == "bool") {
       Ty = llvm::Type::getInt1Ty(Context);
     } else if (N.path->identifier == "char") {
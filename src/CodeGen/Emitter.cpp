@@ -0,0 +1,262 @@
+#include "../../include/CodeGen/Emitter.hpp"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Program.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/TargetParser/Host.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+Emitter::Kind Emitter::parseKind(const std::string &Name) {
+  if (Name == "ir") {
+    return IR;
+  } else if (Name == "bc") {
+    return BC;
+  } else if (Name == "asm") {
+    return Asm;
+  } else if (Name == "obj") {
+    return Obj;
+  } else if (Name == "exe") {
+    return Exe;
+  }
+  throw std::runtime_error("unknown emit kind " + Name);
+}
+
+void Emitter::initTarget() {
+  Machine = createTargetMachine();
+  Module.setTargetTriple(Machine->getTargetTriple().str());
+  Module.setDataLayout(Machine->createDataLayout());
+}
+
+std::unique_ptr<llvm::TargetMachine> Emitter::createTargetMachine() {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  std::string Triple = llvm::sys::getDefaultTargetTriple();
+  std::string Err;
+  const llvm::Target *Target = llvm::TargetRegistry::lookupTarget(Triple, Err);
+  if (!Target) {
+    throw std::runtime_error("no target for " + Triple + ": " + Err);
+  }
+  // PIC so the object links into the default (PIE) executable
+  std::unique_ptr<llvm::TargetMachine> TM(Target->createTargetMachine(
+      Triple, llvm::sys::getHostCPUName(), "", llvm::TargetOptions(), llvm::Reloc::PIC_));
+  if (!TM) {
+    throw std::runtime_error("cannot create target machine for " + Triple);
+  }
+  return TM;
+}
+
+void Emitter::write(Kind K, const std::string &Path, const std::string &Runtime) {
+  if (K == Exe) {
+    if (Runtime.empty()) {
+      throw std::runtime_error("--emit=exe requires --runtime=<path>");
+    }
+    llvm::SmallString<128> ObjPath;
+    if (llvm::sys::fs::createTemporaryFile("r-module", "o", ObjPath)) {
+      throw std::runtime_error("cannot create temporary object file");
+    }
+    try {
+      {
+        std::error_code EC;
+        llvm::raw_fd_ostream OS(ObjPath, EC, llvm::sys::fs::OF_None);
+        if (EC) {
+          throw std::runtime_error("cannot open " + ObjPath.str().str() + ": " + EC.message());
+        }
+        writeNative(Obj, OS);
+      }
+      link({ObjPath.str().str(), Runtime}, Path.empty() ? "a.out" : Path, false);
+    } catch (...) {
+      llvm::sys::fs::remove(ObjPath);
+      throw;
+    }
+    llvm::sys::fs::remove(ObjPath);
+    return;
+  }
+
+  std::unique_ptr<llvm::raw_fd_ostream> File;
+  if (!Path.empty()) {
+    std::error_code EC;
+    File = std::make_unique<llvm::raw_fd_ostream>(
+        Path, EC, K == BC || K == Obj ? llvm::sys::fs::OF_None : llvm::sys::fs::OF_Text);
+    if (EC) {
+      throw std::runtime_error("cannot open " + Path + ": " + EC.message());
+    }
+  }
+  llvm::raw_fd_ostream &OS = File ? *File : llvm::outs();
+
+  if (K == IR) {
+    Module.print(OS, nullptr);
+  } else if (K == BC) {
+    llvm::WriteBitcodeToFile(Module, OS);
+  } else if (OS.supportsSeeking()) {
+    writeNative(K, OS);
+  } else {
+    // the object writer may patch earlier bytes, buffer a pipe
+    llvm::buffer_ostream Buffered(OS);
+    writeNative(K, Buffered);
+  }
+}
+
+// run the target's code generator over M
+static void lower(llvm::Module &M, llvm::TargetMachine &TM, Emitter::Kind K,
+                  llvm::raw_pwrite_stream &OS) {
+  llvm::legacy::PassManager PM;
+  llvm::CodeGenFileType FileType =
+      K == Emitter::Asm ? llvm::CGFT_AssemblyFile : llvm::CGFT_ObjectFile;
+  if (TM.addPassesToEmitFile(PM, OS, nullptr, FileType)) {
+    throw std::runtime_error("target cannot emit this file type");
+  }
+  PM.run(M);
+}
+
+void Emitter::writeNative(Kind K, llvm::raw_pwrite_stream &OS) {
+  if (!Machine) {
+    initTarget();
+  }
+  lower(Module, *Machine, K, OS);
+}
+
+void Emitter::writeSplit(Kind K, const std::string &Path, const std::string &Runtime,
+                         unsigned Threads, const OptimizeFn &Optimize) {
+  if (K != Obj && K != Exe) {
+    throw std::runtime_error("only objects and executables are built in partitions");
+  }
+  if (K == Exe && Runtime.empty()) {
+    throw std::runtime_error("--emit=exe requires --runtime=<path>");
+  }
+  if (!Machine) {
+    initTarget();
+  }
+
+  // partitions call each other's functions: locals become hidden globals,
+  // the suffix keeps them apart from runtime & libc names a program may reuse
+  for (llvm::GlobalValue &GV : Module.global_values()) {
+    if (GV.hasLocalLinkage()) {
+      GV.setName(GV.getName() + ".part");
+      GV.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      GV.setVisibility(llvm::GlobalValue::HiddenVisibility);
+    }
+  }
+  // the clones share Module's context, as bitcode each moves to a thread;
+  // no locals are left to preserve, functions are dealt round robin
+  std::vector<llvm::SmallVector<char, 0>> Bitcode;
+  llvm::SplitModule(
+      Module, Threads,
+      [&](std::unique_ptr<llvm::Module> Part) {
+        Bitcode.emplace_back();
+        llvm::raw_svector_ostream OS(Bitcode.back());
+        llvm::WriteBitcodeToFile(*Part, OS);
+      },
+      true, true);
+
+  std::vector<std::string> Objs;
+  auto removeObjs = [&] {
+    for (const std::string &Obj : Objs) {
+      llvm::sys::fs::remove(Obj);
+    }
+  };
+  std::vector<std::unique_ptr<llvm::TargetMachine>> Machines;
+  for (size_t I = 0; I < Bitcode.size(); ++I) {
+    llvm::SmallString<128> ObjPath;
+    if (llvm::sys::fs::createTemporaryFile("r-module", "o", ObjPath)) {
+      removeObjs();
+      throw std::runtime_error("cannot create temporary object file");
+    }
+    Objs.push_back(ObjPath.str().str());
+    // a target machine is not shared between threads
+    Machines.push_back(createTargetMachine());
+  }
+
+  std::vector<std::exception_ptr> Errors(Bitcode.size());
+  std::vector<std::thread> Workers;
+  for (size_t I = 0; I < Bitcode.size(); ++I) {
+    Workers.emplace_back([&, I] {
+      try {
+        llvm::LLVMContext PartContext;
+        llvm::MemoryBufferRef Buffer(
+            llvm::StringRef(Bitcode[I].data(), Bitcode[I].size()), Objs[I]);
+        llvm::Expected<std::unique_ptr<llvm::Module>> Part =
+            llvm::parseBitcodeFile(Buffer, PartContext);
+        if (!Part) {
+          throw std::runtime_error("cannot read partition: " +
+                                   llvm::toString(Part.takeError()));
+        }
+        Optimize(**Part, Machines[I].get());
+
+        std::error_code EC;
+        llvm::raw_fd_ostream OS(Objs[I], EC, llvm::sys::fs::OF_None);
+        if (EC) {
+          throw std::runtime_error("cannot open " + Objs[I] + ": " + EC.message());
+        }
+        lower(**Part, *Machines[I], Obj, OS);
+      } catch (...) {
+        Errors[I] = std::current_exception();
+      }
+    });
+  }
+  for (std::thread &T : Workers) {
+    T.join();
+  }
+
+  try {
+    for (std::exception_ptr &E : Errors) {
+      if (E) {
+        std::rethrow_exception(E);
+      }
+    }
+    if (K == Exe) {
+      std::vector<std::string> Inputs = Objs;
+      Inputs.push_back(Runtime);
+      link(Inputs, Path.empty() ? "a.out" : Path, false);
+    } else if (!Path.empty()) {
+      link(Objs, Path, true);
+    } else {
+      // one relocatable object, then to stdout
+      llvm::SmallString<128> Joined;
+      if (llvm::sys::fs::createTemporaryFile("r-module", "o", Joined)) {
+        throw std::runtime_error("cannot create temporary object file");
+      }
+      Objs.push_back(Joined.str().str());
+      link({Objs.begin(), Objs.end() - 1}, Objs.back(), true);
+      auto Buffer = llvm::MemoryBuffer::getFile(Objs.back());
+      if (!Buffer) {
+        throw std::runtime_error("cannot read " + Objs.back() + ": " +
+                                 Buffer.getError().message());
+      }
+      llvm::outs() << (*Buffer)->getBuffer();
+    }
+  } catch (...) {
+    removeObjs();
+    throw;
+  }
+  removeObjs();
+}
+
+void Emitter::link(const std::vector<std::string> &Inputs, const std::string &Out,
+                   bool Relocatable) {
+  auto Cc = llvm::sys::findProgramByName("cc");
+  if (!Cc) {
+    throw std::runtime_error("cannot find the system linker driver cc");
+  }
+  std::vector<llvm::StringRef> Args{*Cc};
+  if (Relocatable) {
+    Args.insert(Args.end(), {"-r", "-nostdlib"});
+  }
+  Args.insert(Args.end(), {"-o", Out});
+  Args.insert(Args.end(), Inputs.begin(), Inputs.end());
+  std::string Err;
+  int Ret = llvm::sys::ExecuteAndWait(*Cc, Args, {}, {}, 0, 0, &Err);
+  if (Ret != 0) {
+    throw std::runtime_error("linking failed" + (Err.empty() ? "." : ": " + Err));
+  }
+}
@@ -0,0 +1,55 @@
+#include "../../include/CodeGen/JITRunner.hpp"
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <cstdio>
+#include <stdexcept>
+
+// turn an llvm::Error into the runtime_error used everywhere else
+static void check(llvm::Error Err) {
+  if (Err) {
+    throw std::runtime_error("JIT: " + llvm::toString(std::move(Err)));
+  }
+}
+
+int JITRunner::run(const std::string &Runtime) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  auto JIT = llvm::orc::LLJITBuilder().create();
+  check(JIT.takeError());
+  llvm::orc::JITDylib &Main = (*JIT)->getMainJITDylib();
+  char Prefix = (*JIT)->getDataLayout().getGlobalPrefix();
+
+  auto Process = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(Prefix);
+  check(Process.takeError());
+  Main.addGenerator(std::move(*Process));
+
+  if (llvm::StringRef(Runtime).endswith(".so")) {
+    auto Lib = llvm::orc::DynamicLibrarySearchGenerator::Load(Runtime.c_str(), Prefix);
+    check(Lib.takeError());
+    Main.addGenerator(std::move(*Lib));
+  } else if (!Runtime.empty()) {
+    auto Buf = llvm::MemoryBuffer::getFile(Runtime);
+    if (!Buf) {
+      throw std::runtime_error("cannot open " + Runtime + ": " + Buf.getError().message());
+    }
+    check((*JIT)->addObjectFile(std::move(*Buf)));
+  }
+
+  check((*JIT)->addIRModule(
+      llvm::orc::ThreadSafeModule(std::move(Module), std::move(Context))));
+
+  auto Sym = (*JIT)->lookup("main");
+  check(Sym.takeError());
+  auto *Entry = Sym->toPtr<void (*)()>();
+
+  // the compiler and the program share the C stdio streams
+  llvm::outs().flush();
+  Entry();
+  std::fflush(stdout);
+  return 0;
+}
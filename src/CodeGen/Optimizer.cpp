@@ -0,0 +1,61 @@
+#include "../../include/CodeGen/Optimizer.hpp"
+#include <llvm/IR/PassInstrumentation.h>
+#include <llvm/IR/PassTimingInfo.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Passes/OptimizationLevel.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/Scalar/InductiveRangeCheckElimination.h>
+#include <stdexcept>
+
+void Optimizer::run(llvm::Module &Module, llvm::TargetMachine *Machine) {
+  llvm::PassInstrumentationCallbacks PIC;
+  llvm::TimePassesHandler Timer(TimePasses);
+  Timer.registerCallbacks(PIC);
+
+  llvm::PassBuilder PB(Machine, llvm::PipelineTuningOptions(), {}, &PIC);
+  if (BoundsChecks) {
+    // a loop whose indices are in range for most iterations gets a main
+    // loop without checks, the rest run in pre & post loops
+    PB.registerScalarOptimizerLateEPCallback(
+        [](llvm::FunctionPassManager &FPM, llvm::OptimizationLevel) {
+          FPM.addPass(llvm::IRCEPass());
+        });
+  }
+
+  // the analysis managers must outlive the pass managers using them
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  llvm::ModulePassManager MPM;
+  switch (OptLevel) {
+  case 0:
+    MPM = PB.buildO0DefaultPipeline(llvm::OptimizationLevel::O0);
+    break;
+  case 1:
+    MPM = PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O1);
+    break;
+  case 2:
+    MPM = PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2);
+    break;
+  case 3:
+    MPM = PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+    break;
+  default:
+    throw std::runtime_error("invalid optimization level " + std::to_string(OptLevel));
+  }
+  MPM.run(Module, MAM);
+
+  if (llvm::verifyModule(Module, &llvm::errs())) {
+    throw std::runtime_error("Optimization produced an invalid module.");
+  }
+  if (TimePasses) {
+    Timer.print();
+  }
+}
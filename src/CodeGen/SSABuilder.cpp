@@ -0,0 +1,124 @@
+#include "../../include/CodeGen/SSABuilder.hpp"
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Constants.h>
+#include <stdexcept>
+
+void SSABuilder::write(const std::string &Name, llvm::BasicBlock *BB,
+                       llvm::Value *V) {
+  auto It = Vars.find(Name);
+  if (It == Vars.end()) {
+    throw std::runtime_error("write to undeclared ssa variable " + Name);
+  }
+  It->second.CurrentDef[BB] = V;
+}
+
+llvm::Value *SSABuilder::read(const std::string &Name, llvm::BasicBlock *BB) {
+  auto It = Vars.find(Name);
+  if (It == Vars.end()) {
+    throw std::runtime_error("read of undeclared ssa variable " + Name);
+  }
+  return read(It->second, BB);
+}
+
+llvm::Value *SSABuilder::read(Variable &Var, llvm::BasicBlock *BB) {
+  auto It = Var.CurrentDef.find(BB);
+  if (It != Var.CurrentDef.end() && It->second) {
+    return It->second;
+  }
+  return readRecursive(Var, BB);
+}
+
+llvm::Value *SSABuilder::readRecursive(Variable &Var, llvm::BasicBlock *BB) {
+  llvm::Value *V;
+  if (!Sealed.count(BB)) {
+    // operands are added once the last predecessor is known
+    llvm::PHINode *Phi = createPhi(Var, BB);
+    IncompletePhis[BB].push_back({&Var, Phi});
+    V = Phi;
+  } else if (llvm::BasicBlock *Pred = BB->getSinglePredecessor()) {
+    V = read(Var, Pred);
+  } else if (llvm::pred_empty(BB)) {
+    // unreachable, or read before the first write
+    V = llvm::PoisonValue::get(Var.Ty);
+  } else {
+    // break cycles through loops with an operandless phi
+    llvm::PHINode *Phi = createPhi(Var, BB);
+    Var.CurrentDef[BB] = Phi;
+    V = addPhiOperands(Var, Phi);
+  }
+  Var.CurrentDef[BB] = V;
+  return V;
+}
+
+llvm::Value *SSABuilder::addPhiOperands(Variable &Var, llvm::PHINode *Phi) {
+  llvm::BasicBlock *BB = Phi->getParent();
+  // one entry per edge, a block branching twice to BB is listed twice
+  for (llvm::BasicBlock *Pred : llvm::predecessors(BB)) {
+    Phi->addIncoming(read(Var, Pred), Pred);
+  }
+  return tryRemoveTrivialPhi(Phi);
+}
+
+llvm::Value *SSABuilder::tryRemoveTrivialPhi(llvm::PHINode *Phi) {
+  llvm::Value *Same = nullptr;
+  for (llvm::Value *Op : Phi->incoming_values()) {
+    if (Op == Same || Op == Phi) {
+      continue;
+    }
+    if (Same) {
+      return Phi; // merges at least two values
+    }
+    Same = Op;
+  }
+  if (!Same) {
+    Same = llvm::PoisonValue::get(Phi->getType());
+  }
+
+  llvm::SmallVector<llvm::WeakVH, 8> Users;
+  for (llvm::User *U : Phi->users()) {
+    if (U != Phi && llvm::isa<llvm::PHINode>(U)) {
+      Users.push_back(U);
+    }
+  }
+  Phi->replaceAllUsesWith(Same);
+  Phi->eraseFromParent();
+
+  // phis using this one may have become trivial as well, Same among them
+  llvm::WeakTrackingVH Result(Same);
+  for (llvm::WeakVH &U : Users) {
+    if (auto *UserPhi = llvm::dyn_cast_or_null<llvm::PHINode>(U)) {
+      tryRemoveTrivialPhi(UserPhi);
+    }
+  }
+  return Result;
+}
+
+void SSABuilder::seal(llvm::BasicBlock *BB) {
+  if (!Sealed.insert(BB).second) {
+    return;
+  }
+  auto It = IncompletePhis.find(BB);
+  if (It == IncompletePhis.end()) {
+    return;
+  }
+  auto Phis = std::move(It->second);
+  IncompletePhis.erase(It);
+  for (auto &[Var, Phi] : Phis) {
+    addPhiOperands(*Var, Phi);
+  }
+}
+
+void SSABuilder::clear() {
+  Vars.clear();
+  Sealed.clear();
+  IncompletePhis.clear();
+}
+
+llvm::PHINode *SSABuilder::createPhi(Variable &Var, llvm::BasicBlock *BB) {
+  // in front of the block, the builder may be appending to it
+  if (BB->empty()) {
+    return llvm::PHINode::Create(Var.Ty, 0, "", BB);
+  }
+  return llvm::PHINode::Create(Var.Ty, 0, "", &BB->front());
+}
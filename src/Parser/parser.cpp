@@ -95,25 +95,29 @@ std::shared_ptr<ItemNode> Parser::parseItemNode() {
   if (pos + 1 >= tokens.size()) {
     reportError("parseItemNode: out of range.");
   }
+  int begin = pos;
+  std::shared_ptr<ItemNode> item = nullptr;
   switch (tokens[pos].type)
   {
   case CONST:
     if (tokens[pos + 1].type == FN) {
-      return parseItemFn();
+      item = parseItemFn();
     } else {
-      return parseItemConst();
+      item = parseItemConst();
     }
     break;
-  case FN:     return parseItemFn(); break;
-  case STRUCT: return parseItemStruct(); break;
-  case ENUM:   return parseItemEnum(); break;
-  case TRAIT:  return parseItemTrait(); break;
-  case IMPL:   return parseItemImpl(); break;
+  case FN:     item = parseItemFn(); break;
+  case STRUCT: item = parseItemStruct(); break;
+  case ENUM:   item = parseItemEnum(); break;
+  case TRAIT:  item = parseItemTrait(); break;
+  case IMPL:   item = parseItemImpl(); break;
   default:
     reportError("parseItemNode: not match.");
     break;
   }
-  return nullptr;
+  // used by the semantic cache to fingerprint the item
+  item->setTokenRange(begin, pos);
+  return item;
 }
 
 std::shared_ptr<ItemFn> Parser::parseItemFn() {
@@ -495,7 +499,7 @@ std::shared_ptr<ItemTrait> Parser::parseItemTrait() {
 std::shared_ptr<ItemImpl> Parser::parseItemImpl() {
   std::string identifier;
   std::shared_ptr<TypeNode> type = nullptr;
-  std::vector<std::shared_ptr<ItemAssociatedNode>> associated_items;
+  std::list<std::shared_ptr<ItemAssociatedNode>> associated_items;
   if (pos >= tokens.size() || tokens[pos++].type != IMPL) {
     reportError("parseItemImpl: not match.");
   }
@@ -531,6 +535,8 @@ std::shared_ptr<ItemAssociatedNode> Parser::parseItemAssociatedNode(){
   if (pos >= tokens.size()){
     reportError("parseItemAssociatedNode: out of range.");
   }
+  int begin = pos;
+  std::shared_ptr<ItemAssociatedNode> item = nullptr;
   switch (tokens[pos].type) 
   {
   case CONST:
@@ -538,14 +544,16 @@ std::shared_ptr<ItemAssociatedNode> Parser::parseItemAssociatedNode(){
       reportError("parseItemAssociatedNode: out of range.");
     }
     if (tokens[pos + 1].type == FN) {
-      return parseItemFn();
+      item = parseItemFn();
     } else {
-      return parseItemConst();
+      item = parseItemConst();
     }
-  case FN: return parseItemFn();
+    break;
+  case FN: item = parseItemFn(); break;
   default: reportError("parseItemAssociatedNode: out of range.");
   }
-  return nullptr;
+  item->setTokenRange(begin, pos);
+  return item;
 }
 
 std::shared_ptr<StmtNode> Parser::parseStmtNode(){
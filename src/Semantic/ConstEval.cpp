@@ -0,0 +1,673 @@
+#include "../../include/Semantic/ConstEval.hpp"
+#include "../../include/ASTNode/ExprArrayIndex.hpp"
+#include "../../include/ASTNode/ExprBlock.hpp"
+#include "../../include/ASTNode/ExprField.hpp"
+#include "../../include/ASTNode/ExprGrouped.hpp"
+#include "../../include/ASTNode/ExprIf.hpp"
+#include "../../include/ASTNode/ExprLiteral.hpp"
+#include "../../include/ASTNode/ExprLoop.hpp"
+#include "../../include/ASTNode/ExprMethodCall.hpp"
+#include "../../include/ASTNode/ExprOperator.hpp"
+#include "../../include/ASTNode/ExprPath.hpp"
+#include "../../include/ASTNode/ExprReturn.hpp"
+#include "../../include/ASTNode/ExprStruct.hpp"
+#include "../../include/ASTNode/Path.hpp"
+#include "../../include/ASTNode/PatternIdentifier.hpp"
+#include "../../include/ASTNode/StmtExpr.hpp"
+#include "../../include/ASTNode/StmtLet.hpp"
+#include "../../include/ASTNode/TypeArray.hpp"
+#include "../../include/ASTNode/TypePath.hpp"
+#include "../../include/ASTNode/TypeReference.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <stdexcept>
+
+bool ConstEval::evalCall(ExprCall &N, ConstValue &Ret) {
+  Frames.clear();
+  Control = Normal;
+  try {
+    Ret = evalCallExpr(N);
+  } catch (NotConst &) {
+    return false;
+  }
+  return Ret.isScalar();
+}
+
+ConstValue ConstEval::evalCallExpr(ExprCall &N) {
+  auto *Callee = dynamic_cast<ExprPath *>(N.expr.get());
+  if (!Callee || Callee->path2 || Callee->path1->type != PathType::Identifier) {
+    throw NotConst();
+  }
+  auto it = Fns.find(Callee->path1->identifier);
+  if (it == Fns.end()) {
+    throw NotConst();
+  }
+  std::vector<ConstValue> Args;
+  for (auto &Param : N.params) {
+    Args.push_back(eval(*Param));
+  }
+  return call(*it->second, std::move(Args));
+}
+
+ConstValue ConstEval::call(ItemFn &Fn, std::vector<ConstValue> Args) {
+  if (Frames.size() >= MaxDepth) {
+    throw std::runtime_error("const fn " + Fn.identifier + " exceeds the call depth limit.");
+  }
+  auto &Params = Fn.function_parameters.fn_params;
+  if (Fn.function_parameters.self_param.flag != 0 || Params.size() != Args.size() ||
+      !Fn.block_expr) {
+    throw NotConst();
+  }
+  std::unordered_map<std::string, ConstValue> Scope;
+  for (std::size_t I = 0; I < Params.size(); ++I) {
+    auto *PI = dynamic_cast<PatternIdentifier *>(Params[I].pattern.get());
+    if (!PI) throw NotConst();
+    ConstValue &Arg = Args[I];
+    settle(Params[I].type.get(), Arg);
+    Scope[PI->identifier] = std::move(Arg);
+  }
+  Frames.push_back({std::move(Scope)});
+  ConstValue V = eval(*Fn.block_expr);
+  if (Control == Return) {
+    V = std::move(Carried);
+  }
+  Control = Normal;
+  Frames.pop_back();
+  settle(Fn.function_return_type.get(), V);
+  return V;
+}
+
+void ConstEval::tick() {
+  if (++Steps > MaxSteps) {
+    throw std::runtime_error("const evaluation exceeds the step limit.");
+  }
+}
+
+ConstValue ConstEval::aggregate(std::vector<std::string> Fields, std::vector<ConstValue> Elems) {
+  Cells += Elems.size();
+  if (Cells > MaxCells) {
+    throw std::runtime_error("const evaluation exceeds the memory limit.");
+  }
+  ConstValue V;
+  V.K = ConstValue::Aggregate;
+  V.Fields = std::move(Fields);
+  V.Elems = std::move(Elems);
+  return V;
+}
+
+const QualType *ConstEval::primitive(TypeNode *N) const {
+  if (!N || N->getTypeID() != ASTNode::K_TypePath) return nullptr;
+  auto &Path = *static_cast<TypePath *>(N)->path;
+  if (Path.type != PathType::Identifier) return nullptr;
+  return QualType::getPrimitiveType(Path.identifier);
+}
+
+long ConstEval::wrap(const QualType *Ty, long V) const {
+  if (!Ty) return V;
+  switch (Ty->getTypeID()) {
+  default:
+    return V;
+  case QualType::T_i32:
+    return static_cast<int32_t>(V);
+  case QualType::T_u32:
+    return static_cast<uint32_t>(V);
+  case QualType::T_isize:
+  case QualType::T_usize:
+    return V; // pointer-sized, as wide as long
+  }
+}
+
+namespace {
+
+template <typename T> bool overflows(char Op, T A, T B, long &V) {
+  T R;
+  bool O = Op == '+' ? __builtin_add_overflow(A, B, &R)
+         : Op == '-' ? __builtin_sub_overflow(A, B, &R)
+                     : __builtin_mul_overflow(A, B, &R);
+  V = long(R);
+  return O;
+}
+
+} // namespace
+
+long ConstEval::checked(const QualType *Ty, char Op, long A, long B) const {
+  long V;
+  bool O;
+  switch (Ty ? Ty->getTypeID() : QualType::T_isize) {
+  default:
+  case QualType::T_isize:
+    O = overflows<long>(Op, A, B, V);
+    break;
+  case QualType::T_usize:
+    O = overflows<unsigned long>(Op, A, B, V);
+    break;
+  case QualType::T_i32:
+    O = overflows<int32_t>(Op, A, B, V);
+    break;
+  case QualType::T_u32:
+    O = overflows<uint32_t>(Op, A, B, V);
+    break;
+  }
+  if (O) {
+    throw std::runtime_error("overflow in const evaluation.");
+  }
+  return V;
+}
+
+void ConstEval::settle(TypeNode *N, ConstValue &V) const {
+  if (!N) return;
+  if (N->getTypeID() == ASTNode::K_TypeReference) {
+    return settle(static_cast<TypeReference *>(N)->type.get(), V);
+  }
+  if (N->getTypeID() == ASTNode::K_TypeArray && V.K == ConstValue::Aggregate) {
+    for (auto &E : V.Elems) settle(static_cast<TypeArray *>(N)->type.get(), E);
+    return;
+  }
+  const QualType *Ty = primitive(N);
+  if (V.K == ConstValue::Int && Ty && Ty->isInteger()) {
+    V.Ty = Ty;
+    V.Value = wrap(Ty, V.Value);
+  }
+}
+
+ConstValue ConstEval::cast(TypeNode *N, ConstValue V) const {
+  const QualType *Ty = primitive(N);
+  if (!Ty || !V.isScalar()) throw NotConst();
+  if (Ty->isBool()) {
+    if (V.K != ConstValue::Bool) throw NotConst();
+    return V;
+  }
+  return ConstValue::makeInt(wrap(Ty, V.Value), ConstValue::Int, Ty->isInteger() ? Ty : nullptr);
+}
+
+ConstValue *ConstEval::findLocal(const std::string &Name) {
+  if (Frames.empty()) return nullptr;
+  auto &Scopes = Frames.back();
+  for (auto it = Scopes.rbegin(); it != Scopes.rend(); ++it) {
+    auto found = it->find(Name);
+    if (found != it->end()) return &found->second;
+  }
+  return nullptr;
+}
+
+ConstValue *ConstEval::place(ExprNode &N) {
+  switch (N.getTypeID()) {
+  default:
+    return nullptr;
+  case ASTNode::K_ExprPath: {
+    auto &E = static_cast<ExprPath &>(N);
+    if (E.path2 || E.path1->type != PathType::Identifier) return nullptr;
+    return findLocal(E.path1->identifier);
+  }
+  case ASTNode::K_ExprGrouped:
+    return place(*static_cast<ExprGrouped &>(N).expr);
+  case ASTNode::K_ExprOpUnary: {
+    auto &E = static_cast<ExprOpUnary &>(N);
+    if (E.type != DEREFERENCE_) return nullptr;
+    return place(*E.expr);
+  }
+  case ASTNode::K_ExprIndex: {
+    auto &E = static_cast<ExprIndex &>(N);
+    ConstValue *Base = place(*E.array);
+    if (!Base) return nullptr;
+    ConstValue Idx = eval(*E.index);
+    if (Base->K != ConstValue::Aggregate || !Base->Fields.empty() || !Idx.isScalar()) {
+      throw NotConst();
+    }
+    if (Idx.Value < 0 || Idx.Value >= long(Base->Elems.size())) {
+      throw std::runtime_error("index out of bounds in const evaluation.");
+    }
+    return &Base->Elems[Idx.Value];
+  }
+  case ASTNode::K_ExprField: {
+    auto &E = static_cast<ExprField &>(N);
+    ConstValue *Base = place(*E.expr);
+    if (!Base) return nullptr;
+    auto it = std::find(Base->Fields.begin(), Base->Fields.end(), E.identifier);
+    if (it == Base->Fields.end()) throw NotConst();
+    return &Base->Elems[it - Base->Fields.begin()];
+  }
+  }
+}
+
+ConstValue *ConstEval::lvalue(ExprNode &N) {
+  ConstValue *P = place(N);
+  if (!P) throw NotConst();
+  return P;
+}
+
+void ConstEval::exec(StmtNode &N) {
+  switch (N.getTypeID()) {
+  default:
+    // local items
+    throw NotConst();
+  case ASTNode::K_StmtEmpty:
+    return;
+  case ASTNode::K_StmtExpr:
+    eval(*static_cast<StmtExpr &>(N).expr);
+    return;
+  case ASTNode::K_StmtLet: {
+    auto &S = static_cast<StmtLet &>(N);
+    auto *PI = dynamic_cast<PatternIdentifier *>(S.pattern.get());
+    if (!PI || !S.expr) throw NotConst();
+    ConstValue V = eval(*S.expr);
+    if (Control != Normal) return;
+    settle(S.type.get(), V);
+    Frames.back().back()[PI->identifier] = std::move(V);
+    return;
+  }
+  }
+}
+
+ConstValue ConstEval::evalLoop(ExprNode *Cond, ExprNode &Body) {
+  while (true) {
+    if (Cond) {
+      ConstValue C = eval(*Cond);
+      if (Control != Normal) return ConstValue();
+      if (!C.isScalar()) throw NotConst();
+      if (!C.Value) return ConstValue();
+    }
+    eval(Body);
+    switch (Control) {
+    case Normal:
+      break;
+    case Continue:
+      Control = Normal;
+      break;
+    case Break:
+      Control = Normal;
+      return std::move(Carried);
+    case Return:
+      return ConstValue();
+    }
+  }
+}
+
+ConstValue ConstEval::eval(ExprNode &N) {
+  tick();
+  switch (N.getTypeID()) {
+  default:
+    throw NotConst();
+  case ASTNode::K_ExprLiteralInt: {
+    auto &E = static_cast<ExprLiteralInt &>(N);
+    const QualType *Ty = E.type.empty() ? nullptr : QualType::getPrimitiveType(E.type);
+    if (Ty && !Ty->isInteger()) Ty = nullptr;
+    return ConstValue::makeInt(wrap(Ty, E.literal), ConstValue::Int, Ty);
+  }
+  case ASTNode::K_ExprLiteralBool:
+    return ConstValue::makeInt(static_cast<ExprLiteralBool &>(N).literal, ConstValue::Bool);
+  case ASTNode::K_ExprLiteralChar:
+    return ConstValue::makeInt(static_cast<ExprLiteralChar &>(N).literal);
+  case ASTNode::K_ExprPath: {
+    if (ConstValue *P = place(N)) return *P;
+    auto &E = static_cast<ExprPath &>(N);
+    long V;
+    const QualType *Ty = nullptr;
+    if (!E.path2 && E.path1->type == PathType::Identifier &&
+        Lookup && Lookup(E.path1->identifier, V, Ty)) {
+      return ConstValue::makeInt(V, ConstValue::Int, Ty && Ty->isInteger() ? Ty : nullptr);
+    }
+    throw NotConst();
+  }
+  case ASTNode::K_ExprGrouped:
+    return eval(*static_cast<ExprGrouped &>(N).expr);
+  case ASTNode::K_ExprBlock: {
+    auto &E = static_cast<ExprBlock &>(N);
+    if (Frames.empty()) throw NotConst();
+    Frames.back().emplace_back();
+    ConstValue V;
+    for (auto &S : E.stmts) {
+      exec(*S);
+      if (Control != Normal) break;
+    }
+    if (Control == Normal && E.expr) V = eval(*E.expr);
+    Frames.back().pop_back();
+    return V;
+  }
+  case ASTNode::K_ExprOpUnary: {
+    auto &E = static_cast<ExprOpUnary &>(N);
+    switch (E.type) {
+    case MUT_BORROW_:
+      throw NotConst();
+    case BORROW_:      // a shared reference reads like a copy
+    case DEREFERENCE_:
+      return eval(*E.expr);
+    case NEGATE_: {
+      ConstValue V = eval(*E.expr);
+      if (V.K != ConstValue::Int) throw NotConst();
+      V.Value = checked(V.Ty, '-', 0, V.Value);
+      return V;
+    }
+    case NOT_: {
+      ConstValue V = eval(*E.expr);
+      if (!V.isScalar()) throw NotConst();
+      V.Value = V.K == ConstValue::Bool ? !V.Value : wrap(V.Ty, ~V.Value);
+      return V;
+    }
+    }
+    throw NotConst();
+  }
+  case ASTNode::K_ExprOpBinary:
+    return evalBinary(N);
+  case ASTNode::K_ExprOpCast: {
+    auto &E = static_cast<ExprOpCast &>(N);
+    return cast(E.type.get(), eval(*E.expr));
+  }
+  case ASTNode::K_ExprArrayExpand: {
+    std::vector<ConstValue> Elems;
+    for (auto &I : static_cast<ExprArrayExpand &>(N).elements) {
+      Elems.push_back(eval(*I));
+    }
+    return aggregate({}, std::move(Elems));
+  }
+  case ASTNode::K_ExprArrayAbbreviate: {
+    auto &E = static_cast<ExprArrayAbbreviate &>(N);
+    ConstValue V = eval(*E.value);
+    ConstValue Size = eval(*E.size);
+    if (Size.K != ConstValue::Int || Size.Value < 0) throw NotConst();
+    if (Cells + Size.Value > MaxCells) {
+      throw std::runtime_error("const evaluation exceeds the memory limit.");
+    }
+    return aggregate({}, std::vector<ConstValue>(Size.Value, V));
+  }
+  case ASTNode::K_ExprIndex:
+  case ASTNode::K_ExprField: {
+    if (ConstValue *P = place(N)) return *P;
+    // index or field of a temporary
+    ConstValue Base;
+    if (N.getTypeID() == ASTNode::K_ExprIndex) {
+      auto &E = static_cast<ExprIndex &>(N);
+      Base = eval(*E.array);
+      ConstValue Idx = eval(*E.index);
+      if (Base.K != ConstValue::Aggregate || !Idx.isScalar()) throw NotConst();
+      if (Idx.Value < 0 || Idx.Value >= long(Base.Elems.size())) {
+        throw std::runtime_error("index out of bounds in const evaluation.");
+      }
+      return std::move(Base.Elems[Idx.Value]);
+    }
+    auto &E = static_cast<ExprField &>(N);
+    Base = eval(*E.expr);
+    auto it = std::find(Base.Fields.begin(), Base.Fields.end(), E.identifier);
+    if (it == Base.Fields.end()) throw NotConst();
+    return std::move(Base.Elems[it - Base.Fields.begin()]);
+  }
+  case ASTNode::K_ExprStruct: {
+    auto &E = static_cast<ExprStruct &>(N);
+    std::vector<std::string> Fields;
+    std::vector<ConstValue> Elems;
+    for (auto &F : E.fields) {
+      Fields.push_back(F.identifier);
+      Elems.push_back(eval(*F.expr));
+    }
+    return aggregate(std::move(Fields), std::move(Elems));
+  }
+  case ASTNode::K_ExprCall:
+    return evalCallExpr(static_cast<ExprCall &>(N));
+  case ASTNode::K_ExprMethodCall: {
+    // only .len() of array
+    auto &E = static_cast<ExprMethodCall &>(N);
+    if (E.path->identifier != "len" || !E.params.empty()) throw NotConst();
+    ConstValue *P = place(*E.expr);
+    ConstValue V = P ? ConstValue() : eval(*E.expr);
+    const ConstValue &Arr = P ? *P : V;
+    if (Arr.K != ConstValue::Aggregate || !Arr.Fields.empty()) throw NotConst();
+    return ConstValue::makeInt(Arr.Elems.size(), ConstValue::Int, QualType::getUsizeType());
+  }
+  case ASTNode::K_ExprIf: {
+    auto &E = static_cast<ExprIf &>(N);
+    ConstValue C = eval(*E.condition);
+    if (Control != Normal) return ConstValue();
+    if (C.K != ConstValue::Bool) throw NotConst();
+    if (C.Value) return eval(*E.if_block);
+    if (E.else_block) return eval(*E.else_block);
+    return ConstValue();
+  }
+  case ASTNode::K_ExprLoopInfinite:
+    return evalLoop(nullptr, *static_cast<ExprLoopInfinite &>(N).block);
+  case ASTNode::K_ExprLoopPredicate: {
+    auto &E = static_cast<ExprLoopPredicate &>(N);
+    return evalLoop(E.condition.get(), *E.block);
+  }
+  case ASTNode::K_ExprBreak: {
+    auto &E = static_cast<ExprBreak &>(N);
+    Carried = E.expr ? eval(*E.expr) : ConstValue();
+    Control = Break;
+    return ConstValue();
+  }
+  case ASTNode::K_ExprContinue:
+    Control = Continue;
+    return ConstValue();
+  case ASTNode::K_ExprReturn: {
+    auto &E = static_cast<ExprReturn &>(N);
+    Carried = E.expr ? eval(*E.expr) : ConstValue();
+    Control = Return;
+    return ConstValue();
+  }
+  }
+}
+
+ConstValue ConstEval::evalBinary(ExprNode &Node) {
+  auto &N = static_cast<ExprOpBinary &>(Node);
+  switch (N.type) {
+  case AND_AND_:
+  case OR_OR_: {
+    ConstValue L = eval(*N.left);
+    if (L.K != ConstValue::Bool) throw NotConst();
+    if ((N.type == AND_AND_) != bool(L.Value)) return L;
+    ConstValue R = eval(*N.right);
+    if (R.K != ConstValue::Bool) throw NotConst();
+    return R;
+  }
+  case ASSIGN_: {
+    ConstValue R = eval(*N.right);
+    ConstValue *P = lvalue(*N.left);
+    if (R.K == ConstValue::Int && !R.Ty && P->K == ConstValue::Int && P->Ty) {
+      // a literal takes the type of the place it is stored to
+      R.Ty = P->Ty;
+      R.Value = wrap(R.Ty, R.Value);
+    }
+    *P = std::move(R);
+    return ConstValue();
+  }
+  default:
+    break;
+  }
+
+  ConstValue R = eval(*N.right);
+  ConstValue *P = nullptr;
+  ConstValue L;
+  bool compound = N.type >= PLUS_EQ_;
+  if (compound) {
+    P = lvalue(*N.left);
+    L = *P;
+  } else {
+    L = eval(*N.left);
+  }
+  if (!L.isScalar() || !R.isScalar()) throw NotConst();
+
+  // a literal operand takes the other's type; a shift has its left one
+  bool shift = N.type == SHL_ || N.type == SHL_EQ_ || N.type == SHR_ || N.type == SHR_EQ_;
+  const QualType *Ty = L.Ty || shift ? L.Ty : R.Ty;
+  bool Unsigned = Ty && Ty->isUnsigned();
+  // arithmetic is checked at the width of Ty, the rest computed on the bits
+  unsigned long a = L.Value, b = R.Value;
+  unsigned Bits = Ty && (Ty->isI32() || Ty->isU32()) ? 32 : 64;
+  long V;
+  ConstValue::Kind K = L.K;
+  switch (N.type) {
+  default:
+    throw NotConst();
+  case PLUS_:  case PLUS_EQ_:  V = checked(Ty, '+', L.Value, R.Value); break;
+  case MINUS_: case MINUS_EQ_: V = checked(Ty, '-', L.Value, R.Value); break;
+  case MUL_:   case MUL_EQ_:   V = checked(Ty, '*', L.Value, R.Value); break;
+  case DIV_:   case DIV_EQ_:
+  case MOD_:   case MOD_EQ_:
+    if (R.Value == 0) {
+      throw std::runtime_error("division by zero in const evaluation.");
+    }
+    if (!Unsigned && R.Value == -1 &&
+        L.Value == (Ty && Ty->isI32() ? long(INT32_MIN) : LONG_MIN)) {
+      throw std::runtime_error("division overflow in const evaluation.");
+    }
+    if (N.type == DIV_ || N.type == DIV_EQ_)
+      V = Unsigned ? long(a / b) : L.Value / R.Value;
+    else
+      V = Unsigned ? long(a % b) : L.Value % R.Value;
+    break;
+  case AND_: case AND_EQ_: V = L.Value & R.Value; break;
+  case OR_:  case OR_EQ_:  V = L.Value | R.Value; break;
+  case XOR_: case XOR_EQ_: V = L.Value ^ R.Value; break;
+  case SHL_: case SHL_EQ_:
+  case SHR_: case SHR_EQ_:
+    // the amount is unsigned to rustc, a negative one is out of range too
+    if (b >= Bits) {
+      throw std::runtime_error("overflow in const evaluation.");
+    }
+    if (N.type == SHL_ || N.type == SHL_EQ_)
+      V = long(a << b);
+    else
+      V = Unsigned ? long(a >> b) : L.Value >> b;
+    break;
+  case EQUAL_:         V = L.Value == R.Value; K = ConstValue::Bool; break;
+  case NOT_EQUAL_:     V = L.Value != R.Value; K = ConstValue::Bool; break;
+  case GREATER_:       V = Unsigned ? a > b : L.Value > R.Value;   K = ConstValue::Bool; break;
+  case LESS_:          V = Unsigned ? a < b : L.Value < R.Value;   K = ConstValue::Bool; break;
+  case GREATER_EQUAL_: V = Unsigned ? a >= b : L.Value >= R.Value; K = ConstValue::Bool; break;
+  case LESS_EQUAL_:    V = Unsigned ? a <= b : L.Value <= R.Value; K = ConstValue::Bool; break;
+  }
+  if (K == ConstValue::Bool) {
+    Ty = nullptr;
+  } else {
+    V = wrap(Ty, V);
+  }
+  if (compound) {
+    P->Value = V;
+    P->Ty = Ty;
+    return ConstValue();
+  }
+  return ConstValue::makeInt(V, K, Ty);
+}
+
+// free names of const fn bodies, approximating scopes by the set of names bound so far
+struct ConstEval::NameCollector {
+  const ConstFns &Fns;
+  std::vector<std::string> &Names;
+  std::vector<ItemFn *> Seen;
+
+  void fn(ItemFn &Fn) {
+    if (std::find(Seen.begin(), Seen.end(), &Fn) != Seen.end() || !Fn.block_expr) return;
+    Seen.push_back(&Fn);
+    std::vector<std::string> Bound;
+    for (auto &P : Fn.function_parameters.fn_params) {
+      if (auto *PI = dynamic_cast<PatternIdentifier *>(P.pattern.get()))
+        Bound.push_back(PI->identifier);
+    }
+    expr(*Fn.block_expr, Bound);
+  }
+
+  void stmt(StmtNode &N, std::vector<std::string> &Bound) {
+    if (N.getTypeID() == ASTNode::K_StmtExpr) {
+      return expr(*static_cast<StmtExpr &>(N).expr, Bound);
+    }
+    if (N.getTypeID() == ASTNode::K_StmtLet) {
+      auto &S = static_cast<StmtLet &>(N);
+      if (S.expr) expr(*S.expr, Bound);
+      if (auto *PI = dynamic_cast<PatternIdentifier *>(S.pattern.get()))
+        Bound.push_back(PI->identifier);
+    }
+  }
+
+  void expr(ExprNode &N, std::vector<std::string> &Bound) {
+    switch (N.getTypeID()) {
+    default:
+      return;
+    case ASTNode::K_ExprPath: {
+      auto &E = static_cast<ExprPath &>(N);
+      if (E.path2 || E.path1->type != PathType::Identifier) return;
+      auto &Name = E.path1->identifier;
+      if (std::find(Bound.begin(), Bound.end(), Name) == Bound.end())
+        Names.push_back(Name);
+      return;
+    }
+    case ASTNode::K_ExprGrouped:
+      return expr(*static_cast<ExprGrouped &>(N).expr, Bound);
+    case ASTNode::K_ExprBlock: {
+      auto &E = static_cast<ExprBlock &>(N);
+      for (auto &S : E.stmts) stmt(*S, Bound);
+      if (E.expr) expr(*E.expr, Bound);
+      return;
+    }
+    case ASTNode::K_ExprOpUnary:
+      return expr(*static_cast<ExprOpUnary &>(N).expr, Bound);
+    case ASTNode::K_ExprOpBinary: {
+      auto &E = static_cast<ExprOpBinary &>(N);
+      expr(*E.left, Bound);
+      return expr(*E.right, Bound);
+    }
+    case ASTNode::K_ExprOpCast:
+      return expr(*static_cast<ExprOpCast &>(N).expr, Bound);
+    case ASTNode::K_ExprArrayExpand:
+      for (auto &I : static_cast<ExprArrayExpand &>(N).elements) expr(*I, Bound);
+      return;
+    case ASTNode::K_ExprArrayAbbreviate: {
+      auto &E = static_cast<ExprArrayAbbreviate &>(N);
+      expr(*E.value, Bound);
+      return expr(*E.size, Bound);
+    }
+    case ASTNode::K_ExprIndex: {
+      auto &E = static_cast<ExprIndex &>(N);
+      expr(*E.array, Bound);
+      return expr(*E.index, Bound);
+    }
+    case ASTNode::K_ExprField:
+      return expr(*static_cast<ExprField &>(N).expr, Bound);
+    case ASTNode::K_ExprStruct:
+      for (auto &F : static_cast<ExprStruct &>(N).fields) expr(*F.expr, Bound);
+      return;
+    case ASTNode::K_ExprMethodCall:
+      return expr(*static_cast<ExprMethodCall &>(N).expr, Bound);
+    case ASTNode::K_ExprCall: {
+      auto &E = static_cast<ExprCall &>(N);
+      for (auto &P : E.params) expr(*P, Bound);
+      auto *Callee = dynamic_cast<ExprPath *>(E.expr.get());
+      if (Callee && !Callee->path2) {
+        auto it = Fns.find(Callee->path1->identifier);
+        if (it != Fns.end()) fn(*it->second);
+      }
+      return;
+    }
+    case ASTNode::K_ExprIf: {
+      auto &E = static_cast<ExprIf &>(N);
+      expr(*E.condition, Bound);
+      expr(*E.if_block, Bound);
+      if (E.else_block) expr(*E.else_block, Bound);
+      return;
+    }
+    case ASTNode::K_ExprLoopInfinite:
+      return expr(*static_cast<ExprLoopInfinite &>(N).block, Bound);
+    case ASTNode::K_ExprLoopPredicate: {
+      auto &E = static_cast<ExprLoopPredicate &>(N);
+      expr(*E.condition, Bound);
+      return expr(*E.block, Bound);
+    }
+    case ASTNode::K_ExprBreak: {
+      auto &E = static_cast<ExprBreak &>(N);
+      if (E.expr) expr(*E.expr, Bound);
+      return;
+    }
+    case ASTNode::K_ExprReturn: {
+      auto &E = static_cast<ExprReturn &>(N);
+      if (E.expr) expr(*E.expr, Bound);
+      return;
+    }
+    }
+  }
+};
+
+void ConstEval::collectFreeNames(const ConstFns &Fns, ExprCall &N,
+                                 std::vector<std::string> &Names) {
+  NameCollector C{Fns, Names, {}};
+  std::vector<std::string> Bound;
+  C.expr(N, Bound);
+}
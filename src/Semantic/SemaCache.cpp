@@ -0,0 +1,631 @@
+#include "../../include/Semantic/SemaCache.hpp"
+#include "../../include/Semantic/SymbolChecker.hpp"
+#include "../../include/ASTNode/ExprArrayIndex.hpp"
+#include "../../include/ASTNode/ExprBlock.hpp"
+#include "../../include/ASTNode/ExprCall.hpp"
+#include "../../include/ASTNode/ExprField.hpp"
+#include "../../include/ASTNode/ExprGrouped.hpp"
+#include "../../include/ASTNode/ExprIf.hpp"
+#include "../../include/ASTNode/ExprLiteral.hpp"
+#include "../../include/ASTNode/ExprLoop.hpp"
+#include "../../include/ASTNode/ExprMethodCall.hpp"
+#include "../../include/ASTNode/ExprOperator.hpp"
+#include "../../include/ASTNode/ExprPath.hpp"
+#include "../../include/ASTNode/ExprReturn.hpp"
+#include "../../include/ASTNode/ExprStruct.hpp"
+#include "../../include/ASTNode/Path.hpp"
+#include "../../include/ASTNode/PatternIdentifier.hpp"
+#include "../../include/ASTNode/StmtExpr.hpp"
+#include "../../include/ASTNode/StmtLet.hpp"
+#include "../../include/ASTNode/TypeArray.hpp"
+#include "../../include/ASTNode/TypeReference.hpp"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// bump when the record layout or the checker output changes
+static const char *CacheVersion = "sema-cache-3";
+
+namespace {
+
+struct Hasher { // FNV-1a
+  std::uint64_t H = 1469598103934665603ULL;
+
+  void add(const std::string &S) {
+    for (unsigned char C : S) {
+      H ^= C;
+      H *= 1099511628211ULL;
+    }
+    // terminator, so ("ab","c") and ("a","bc") differ
+    H ^= 0xff;
+    H *= 1099511628211ULL;
+  }
+
+  void add(std::uint64_t V) { add(std::to_string(V)); }
+};
+
+std::uint64_t hashOf(const std::string &S) {
+  Hasher H;
+  H.add(S);
+  return H.H;
+}
+
+// a corrupted file must not reach std::stol's own exceptions
+long toNumber(const std::string &S) {
+  std::size_t I = !S.empty() && S[0] == '-';
+  if (I == S.size() || S.size() - I > 18 ||
+      !std::all_of(S.begin() + I, S.end(), [](unsigned char C) { return std::isdigit(C); })) {
+    throw std::runtime_error("stale semantic cache entry.");
+  }
+  return std::stol(S);
+}
+
+// visit every expr of a fn body in the same order for record and replay
+class BodyWalker {
+private:
+  ItemFn &Fn;
+  SymTable *Syms = nullptr;
+  std::vector<std::string> *Out = nullptr;      // record
+  const std::vector<std::string> *In = nullptr; // replay
+  std::size_t Cur = 0;
+  unsigned OldBase = 0, NewBase = 0;
+  bool DryRun = false; // replay: only check the entry, leave the body alone
+
+public:
+  bool cacheable = true;
+
+  BodyWalker(ItemFn &Fn, std::vector<std::string> &Out) : Fn(Fn), Out(&Out) {}
+
+  BodyWalker(ItemFn &Fn, const SemaCache::Entry &E, SymTable &Syms, unsigned NewBase,
+             bool DryRun)
+      : Fn(Fn), Syms(&Syms), In(&E.Records), OldBase(E.Base), NewBase(NewBase),
+        DryRun(DryRun) {}
+
+  void walk() {
+    block(*Fn.block_expr);
+    if (In && Cur != In->size()) {
+      throw std::runtime_error("stale semantic cache entry.");
+    }
+  }
+
+private:
+  const std::string &next() {
+    if (Cur >= In->size()) {
+      throw std::runtime_error("stale semantic cache entry.");
+    }
+    return (*In)[Cur++];
+  }
+
+  const QualType *decode(const std::string &S) {
+    std::size_t Pos = 0;
+    return SemaCache::decodeType(S, Pos, *Syms);
+  }
+
+  // the recorded name was made by LocalScope from a scope ID of the old run
+  std::string rebase(const std::string &S, const std::string &Orig) {
+    if (S == Orig) return S;
+    std::size_t Sep = S.rfind('_');
+    if (Sep == std::string::npos) {
+      throw std::runtime_error("stale semantic cache entry.");
+    }
+    long ID = toNumber(S.substr(Sep + 1));
+    if (ID < 0 || ID > UINT_MAX) {
+      throw std::runtime_error("stale semantic cache entry.");
+    }
+    unsigned NewID = ID - OldBase + NewBase;
+    if (S == LocalScope::genName(Orig, ID)) {
+      return LocalScope::genName(Orig, NewID);
+    }
+    if (S == LocalScope::genName(LocalScope::genName(Orig, ID), ID)) {
+      return LocalScope::genName(LocalScope::genName(Orig, NewID), NewID);
+    }
+    throw std::runtime_error("stale semantic cache entry.");
+  }
+
+  void block(ExprBlock &N) { node(N); }
+
+  void stmt(StmtNode &N) {
+    switch (N.getTypeID()) {
+    default:
+    // local const lives in the global const table
+    case ASTNode::K_StmtItem:
+      if (In) throw std::runtime_error("stale semantic cache entry.");
+      cacheable = false;
+      return;
+    case ASTNode::K_StmtEmpty:
+      return;
+    case ASTNode::K_StmtExpr:
+      return slot(static_cast<StmtExpr &>(N).expr);
+    case ASTNode::K_StmtLet:
+      return let(static_cast<StmtLet &>(N));
+    }
+  }
+
+  void let(StmtLet &N) {
+    type(*N.type);
+    slot(N.expr);
+    PatternIdentifier *PI = dynamic_cast<PatternIdentifier *>(N.pattern.get());
+    if (!PI) {
+      cacheable = false;
+      return;
+    }
+    if (Out) {
+      const VarDecl &Decl = Fn.getVarDecl(PI->identifier);
+      Out->push_back(PI->identifier);
+      Out->push_back(SemaCache::encodeType(Decl.Ty));
+      Out->push_back(Decl.mut ? "1" : "0");
+      return;
+    }
+    std::string Name = rebase(next(), PI->identifier);
+    const QualType *Ty = decode(next());
+    bool mut = next() == "1";
+    if (DryRun) return;
+    PI->identifier = Name;
+    Fn.createVarDecl(Name, Ty, mut);
+  }
+
+  void type(TypeNode &N) {
+    switch (N.getTypeID()) {
+    default:
+      return;
+    case ASTNode::K_TypeArray: {
+      auto &TA = static_cast<TypeArray &>(N);
+      type(*TA.type);
+      return slot(TA.expr);
+    }
+    case ASTNode::K_TypeReference:
+      return type(*static_cast<TypeReference &>(N).type);
+    }
+  }
+
+  void slot(std::shared_ptr<ExprNode> &E) {
+    if (In && Cur + 1 < In->size() &&
+        (*In)[Cur] == std::to_string(ASTNode::K_ExprLiteralString) &&
+        E->getTypeID() != ASTNode::K_ExprLiteralString) {
+      // the checker replaced .to_string() by a string literal
+      ++Cur;
+      const QualType *Ty = decode(next());
+      auto *PTy = dynamic_cast<const PointerQualType *>(Ty);
+      auto *STy = PTy ? dynamic_cast<const StringQualType *>(PTy->getElemType()) : nullptr;
+      if (!STy) {
+        throw std::runtime_error("stale semantic cache entry.");
+      }
+      if (DryRun) return;
+      E = std::make_shared<ExprLiteralString>(ExprLiteralString(STy->getString()));
+      E->setQualType(Ty);
+      return;
+    }
+    node(*E);
+  }
+
+  void node(ExprNode &N) {
+    if (Out) {
+      Out->push_back(std::to_string(N.getTypeID()));
+      Out->push_back(N.hasQualType() ? SemaCache::encodeType(N.getQualType()) : "-");
+    } else {
+      if (next() != std::to_string(N.getTypeID())) {
+        throw std::runtime_error("stale semantic cache entry.");
+      }
+      const std::string &S = next();
+      const QualType *Ty = S != "-" ? decode(S) : nullptr;
+      if (Ty && !DryRun) N.setQualType(Ty);
+    }
+
+    switch (N.getTypeID()) {
+    default:
+      throw std::runtime_error("unexpected expr node.");
+    case ASTNode::K_ExprBreak: {
+      auto &E = static_cast<ExprBreak &>(N);
+      if (E.expr) slot(E.expr);
+      return;
+    }
+    case ASTNode::K_ExprReturn: {
+      auto &E = static_cast<ExprReturn &>(N);
+      if (E.expr) slot(E.expr);
+      return;
+    }
+    case ASTNode::K_ExprContinue:
+    case ASTNode::K_ExprLiteralBool:
+    case ASTNode::K_ExprLiteralChar:
+    case ASTNode::K_ExprLiteralInt:
+    case ASTNode::K_ExprLiteralString:
+      return;
+    case ASTNode::K_ExprArrayAbbreviate: {
+      auto &E = static_cast<ExprArrayAbbreviate &>(N);
+      slot(E.value);
+      return slot(E.size);
+    }
+    case ASTNode::K_ExprArrayExpand:
+      for (auto &I : static_cast<ExprArrayExpand &>(N).elements) slot(I);
+      return;
+    case ASTNode::K_ExprBlock: {
+      auto &E = static_cast<ExprBlock &>(N);
+      for (auto &ST : E.stmts) stmt(*ST);
+      if (E.expr) slot(E.expr);
+      return;
+    }
+    case ASTNode::K_ExprCall: {
+      auto &E = static_cast<ExprCall &>(N);
+      slot(E.expr);
+      for (auto &I : E.params) slot(I);
+      return;
+    }
+    case ASTNode::K_ExprMethodCall: {
+      auto &E = static_cast<ExprMethodCall &>(N);
+      slot(E.expr);
+      for (auto &I : E.params) slot(I);
+      return;
+    }
+    case ASTNode::K_ExprField:
+      return slot(static_cast<ExprField &>(N).expr);
+    case ASTNode::K_ExprGrouped:
+      return slot(static_cast<ExprGrouped &>(N).expr);
+    case ASTNode::K_ExprOpUnary: {
+      auto &E = static_cast<ExprOpUnary &>(N);
+      slot(E.expr);
+      // the checker marks borrowed locals, codegen keeps them in memory
+      if (In && !DryRun && (E.type == BORROW_ || E.type == MUT_BORROW_)) {
+        if (const ExprPath *P = Checker::getPlaceRoot(*E.expr)) {
+          Fn.setVarAddrTaken(P->path1->identifier);
+        }
+      }
+      return;
+    }
+    case ASTNode::K_ExprOpCast: {
+      auto &E = static_cast<ExprOpCast &>(N);
+      slot(E.expr);
+      return type(*E.type);
+    }
+    case ASTNode::K_ExprOpBinary: {
+      auto &E = static_cast<ExprOpBinary &>(N);
+      slot(E.left);
+      return slot(E.right);
+    }
+    case ASTNode::K_ExprIf: {
+      auto &E = static_cast<ExprIf &>(N);
+      slot(E.condition);
+      block(*E.if_block);
+      if (E.else_block) slot(E.else_block);
+      return;
+    }
+    case ASTNode::K_ExprIndex: {
+      auto &E = static_cast<ExprIndex &>(N);
+      slot(E.array);
+      return slot(E.index);
+    }
+    case ASTNode::K_ExprLoopInfinite:
+      return block(*static_cast<ExprLoopInfinite &>(N).block);
+    case ASTNode::K_ExprLoopPredicate: {
+      auto &E = static_cast<ExprLoopPredicate &>(N);
+      slot(E.condition);
+      return block(*E.block);
+    }
+    case ASTNode::K_ExprPath: {
+      auto &E = static_cast<ExprPath &>(N);
+      if (E.path2 || E.path1->type != PathType::Identifier) return;
+      // locals are renamed by the checker
+      if (Out) {
+        Out->push_back(E.path1->identifier);
+      } else {
+        std::string Name = rebase(next(), E.path1->identifier);
+        if (!DryRun) E.path1->identifier = Name;
+      }
+      return;
+    }
+    case ASTNode::K_ExprStruct: {
+      auto &E = static_cast<ExprStruct &>(N);
+      node(*E.path);
+      for (auto &F : E.fields) slot(F.expr);
+      return;
+    }
+    }
+  }
+};
+
+// length-prefixed string, so names and string literals need no escaping
+void writeString(std::ostream &OS, const std::string &S) {
+  OS << S.size() << ':' << S;
+}
+
+bool readString(std::istream &IS, std::string &S) {
+  std::size_t Len;
+  char Colon;
+  if (!(IS >> Len) || !IS.get(Colon) || Colon != ':') return false;
+  S.resize(Len);
+  return Len == 0 || IS.read(&S[0], Len);
+}
+
+} // namespace
+
+void SemaCache::load() {
+  std::ifstream IS(Path, std::ios::binary);
+  if (!IS) return;
+  std::string Version;
+  std::size_t Count;
+  if (!readString(IS, Version) || Version != CacheVersion || !(IS >> Count)) return;
+  std::unordered_map<std::string, Entry> Loaded;
+  for (std::size_t I = 0; I < Count; ++I) {
+    std::string Key;
+    Entry E;
+    std::size_t Size;
+    if (!readString(IS, Key) || !(IS >> E.Hash >> E.Base >> E.Scopes >> Size)) return;
+    E.Records.resize(Size);
+    for (auto &R : E.Records) {
+      if (!readString(IS, R)) return;
+    }
+    Loaded[Key] = std::move(E);
+  }
+  Old = std::move(Loaded);
+}
+
+void SemaCache::save() const {
+  std::ofstream OS(Path, std::ios::binary | std::ios::trunc);
+  if (!OS) {
+    throw std::runtime_error("can not write semantic cache " + Path);
+  }
+  writeString(OS, CacheVersion);
+  OS << ' ' << New.size() << '\n';
+  for (auto &[Key, E] : New) {
+    writeString(OS, Key);
+    OS << ' ' << E.Hash << ' ' << E.Base << ' ' << E.Scopes << ' '
+       << E.Records.size() << '\n';
+    for (auto &R : E.Records) {
+      writeString(OS, R);
+      OS << ' ';
+    }
+    OS << '\n';
+  }
+}
+
+void SemaCache::indexSignatures(SymTable &Syms, const ConstEval::ConstFns &ConstFns) {
+  SigIndex.clear();
+  // a name may denote several things (fn, field, method, variant ...),
+  // their hashes are summed so the order of the tables does not matter
+  for (auto &[Name, Ty] : Syms.fnTable.getTable()) {
+    SigIndex[Name] += hashOf("fn " + Name + encodeType(Ty));
+  }
+  for (auto &[Name, Ty] : Syms.structTable.getTable()) {
+    Hasher Struct;
+    Struct.add("struct " + Name);
+    for (auto &F : Ty->getFields()) {
+      std::string Sig = Name + "." + F.Name + encodeType(F.Type);
+      Struct.add(Sig);
+      SigIndex[F.Name] += hashOf(Sig);
+    }
+    std::vector<std::pair<std::string, const FuncQualType *>> Methods(
+        Ty->getMethods().begin(), Ty->getMethods().end());
+    std::sort(Methods.begin(), Methods.end());
+    for (auto &[MName, MTy] : Methods) {
+      std::string Sig = Name + "::" + MName + encodeType(MTy);
+      Struct.add(Sig);
+      SigIndex[MName] += hashOf(Sig);
+    }
+    SigIndex[Name] += Struct.H;
+  }
+  for (auto &[Name, Ty] : Syms.enumTable.getTable()) {
+    Hasher Enum;
+    Enum.add("enum " + Name);
+    for (auto &V : Ty->getFields()) {
+      Enum.add(V);
+      SigIndex[V] += hashOf(Name + "::" + V);
+    }
+    SigIndex[Name] += Enum.H;
+  }
+  for (auto &[Name, Const] : Syms.constTable.getTable()) {
+    SigIndex[Name] += hashOf("const " + Name + encodeType(Const.first) +
+                             std::to_string(Const.second));
+  }
+
+  // tokens of each const fn body, with the signatures of the other names in it
+  std::unordered_map<std::string, std::uint64_t> Bodies;
+  std::unordered_map<std::string, std::vector<std::string>> Callees;
+  for (auto &[Name, Fn] : ConstFns) {
+    Hasher Body;
+    std::size_t End = std::min(Fn->getTokenEnd(), Tokens.size());
+    for (std::size_t I = Fn->getTokenBegin(); I < End; ++I) {
+      const Token &T = Tokens[I];
+      Body.add(std::to_string(T.type));
+      Body.add(T.str);
+      if (T.type != IDENTIFIER) continue;
+      if (ConstFns.count(T.str)) {
+        Callees[Name].push_back(T.str);
+      } else if (SigIndex.count(T.str)) {
+        Body.add(SigIndex[T.str]);
+      }
+    }
+    Bodies[Name] = Body.H;
+  }
+  for (auto &[Name, Fn] : ConstFns) {
+    // every const fn reachable from Name, in a stable order
+    std::vector<std::string> Reached = {Name};
+    for (std::size_t I = 0; I < Reached.size(); ++I) {
+      for (auto &Callee : Callees[Reached[I]]) {
+        if (std::find(Reached.begin(), Reached.end(), Callee) == Reached.end())
+          Reached.push_back(Callee);
+      }
+    }
+    std::sort(Reached.begin(), Reached.end());
+    Hasher Closure;
+    for (auto &Callee : Reached) {
+      Closure.add(Callee);
+      Closure.add(Bodies[Callee]);
+    }
+    SigIndex[Name] += Closure.H;
+  }
+}
+
+std::uint64_t SemaCache::fingerprint(const ItemFn &N, const StructQualType *Self) const {
+  Hasher H;
+  H.add(CacheVersion);
+  auto mix = [&](const std::string &Name) {
+    auto it = SigIndex.find(Name);
+    if (it != SigIndex.end()) H.add(it->second);
+  };
+  if (Self) {
+    H.add(Self->getName());
+    mix(Self->getName());
+  }
+  std::size_t End = std::min(N.getTokenEnd(), Tokens.size());
+  for (std::size_t I = N.getTokenBegin(); I < End; ++I) {
+    const Token &T = Tokens[I];
+    H.add(std::to_string(T.type));
+    H.add(T.str);
+    if (T.type == IDENTIFIER) mix(T.str);
+  }
+  return H.H;
+}
+
+const SemaCache::Entry *SemaCache::lookup(const std::string &Key, std::uint64_t Hash) {
+  auto it = Old.find(Key);
+  if (it == Old.end() || it->second.Hash != Hash) return nullptr;
+  // keep the entry for the next run
+  return &(New[Key] = it->second);
+}
+
+bool SemaCache::replay(const Entry &E, ItemFn &N, SymTable &Syms) {
+  // walk the entry once without touching the body, a stale or corrupted
+  // one must not leave it half replayed
+  unsigned Base = LocalScope::peekID();
+  try {
+    BodyWalker(N, E, Syms, Base, true).walk();
+  } catch (const std::runtime_error &) {
+    return false;
+  }
+  LocalScope::reserveIDs(E.Scopes);
+  BodyWalker(N, E, Syms, Base, false).walk();
+  return true;
+}
+
+void SemaCache::record(const std::string &Key, std::uint64_t Hash, ItemFn &N,
+                       unsigned Base, unsigned Scopes) {
+  Entry E;
+  E.Hash = Hash;
+  E.Base = Base;
+  E.Scopes = Scopes;
+  BodyWalker W(N, E.Records);
+  W.walk();
+  if (W.cacheable) {
+    New[Key] = std::move(E);
+  } else {
+    // drop a stale entry lookup kept
+    New.erase(Key);
+  }
+}
+
+std::string SemaCache::encodeType(const QualType *Ty) {
+  switch (Ty->getTypeID()) {
+  case QualType::T_i32:    return "i";
+  case QualType::T_u32:    return "u";
+  case QualType::T_usize:  return "U";
+  case QualType::T_isize:  return "I";
+  case QualType::T_bool:   return "b";
+  case QualType::T_char:   return "c";
+  case QualType::T_void:   return "v";
+  case QualType::T_string: {
+    std::string S = static_cast<const StringQualType *>(Ty)->getString();
+    return "s" + std::to_string(S.size()) + ":" + S;
+  }
+  case QualType::T_ptr: {
+    auto *PTy = static_cast<const PointerQualType *>(Ty);
+    return std::string(PTy->isMut() ? "P1" : "P0") + encodeType(PTy->getElemType());
+  }
+  case QualType::T_array: {
+    auto *ATy = static_cast<const ArrayQualType *>(Ty);
+    return "A" + std::to_string(ATy->getLength()) + ";" + encodeType(ATy->getElemType());
+  }
+  case QualType::T_struct: {
+    const std::string &Name = static_cast<const StructQualType *>(Ty)->getName();
+    return "S" + std::to_string(Name.size()) + ":" + Name;
+  }
+  case QualType::T_enum: {
+    const std::string &Name = static_cast<const EnumQualType *>(Ty)->getName();
+    return "E" + std::to_string(Name.size()) + ":" + Name;
+  }
+  case QualType::T_func: {
+    auto *FTy = static_cast<const FuncQualType *>(Ty);
+    std::string S = "F" + std::to_string(FTy->getParamTypes().size()) + ";";
+    for (auto *P : FTy->getParamTypes()) S += encodeType(P);
+    return S + encodeType(FTy->getReturnType());
+  }
+  case QualType::T_intLiteral:
+    return "L" + std::to_string(static_cast<const IntLiteralQualType *>(Ty)->getValue()) + ";";
+  }
+  throw std::runtime_error("unexpected type in semantic cache.");
+}
+
+const QualType *SemaCache::decodeType(const std::string &S, std::size_t &Pos, SymTable &Syms) {
+  if (Pos >= S.size()) {
+    throw std::runtime_error("stale semantic cache entry.");
+  }
+  // <number><Stop>
+  auto number = [&](char Stop) {
+    std::size_t End = S.find(Stop, Pos);
+    if (End == std::string::npos) {
+      throw std::runtime_error("stale semantic cache entry.");
+    }
+    long V = toNumber(S.substr(Pos, End - Pos));
+    Pos = End + 1;
+    return V;
+  };
+  // lengths and counts, never negative
+  auto count = [&](char Stop) {
+    long V = number(Stop);
+    if (V < 0) {
+      throw std::runtime_error("stale semantic cache entry.");
+    }
+    return static_cast<std::size_t>(V);
+  };
+  auto name = [&]() {
+    std::size_t Len = count(':');
+    if (Len > S.size() - Pos) {
+      throw std::runtime_error("stale semantic cache entry.");
+    }
+    std::string Name = S.substr(Pos, Len);
+    Pos += Len;
+    return Name;
+  };
+  switch (S[Pos++]) {
+  case 'i': return QualType::getI32Type();
+  case 'u': return QualType::getU32Type();
+  case 'U': return QualType::getUsizeType();
+  case 'I': return QualType::getIsizeType();
+  case 'b': return QualType::getBoolType();
+  case 'c': return QualType::getCharType();
+  case 'v': return QualType::getVoidType();
+  case 's': return StringQualType::create(name());
+  case 'P': {
+    bool mut = S[Pos++] == '1';
+    return PointerQualType::create(mut, decodeType(S, Pos, Syms));
+  }
+  case 'A': {
+    std::size_t Len = count(';');
+    return ArrayQualType::create(decodeType(S, Pos, Syms), Len);
+  }
+  case 'S': {
+    const QualType *Ty = Syms.structTable.getTy(name());
+    if (Ty) return Ty;
+    break;
+  }
+  case 'E': {
+    std::string Name = name();
+    if (Syms.enumTable.count(Name)) return Syms.enumTable.getTy(Name);
+    break;
+  }
+  case 'F': {
+    std::size_t Size = count(';');
+    std::vector<const QualType *> Params;
+    for (std::size_t I = 0; I < Size; ++I) {
+      Params.push_back(decodeType(S, Pos, Syms));
+    }
+    return FuncQualType::create(false, Params, decodeType(S, Pos, Syms));
+  }
+  case 'L':
+    return IntLiteralQualType::create(number(';'));
+  }
+  throw std::runtime_error("stale semantic cache entry.");
+}
@@ -17,6 +17,7 @@
 #include "../../include/ASTNode/TypeUnit.hpp"
 #include "../../include/Semantic/ConstSolver.hpp"
 #include "../../include/Semantic/Type.hpp"
+#include <algorithm>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -46,76 +47,91 @@ Checker::Checker(std::shared_ptr<Crate> &Prog, SymTable &Syms)
 }
 
 void Checker::check() {
-  initRun();// move nested items (except const) to global
-  firstRun();// collect struct, enum, const, trait and merge impl
-  secondRun();// calculate the value of const items in global
-  thirdRun();// collect field and impl of struct, signature of fn
-  forthRun();// check impl trait of struct & trait
-  fifthRun();// check each fn & impl in detail
+  collectDecls();// collect struct, enum, const, trait and merge impl
+  solveConsts();// calculate the value of const items in global
+  collectSignatures();// collect field and impl of struct, signature of fn
+  if (Cache) Cache->indexSignatures(Syms, ConstFns);
+  checkBodies();// check each fn & impl in detail
 }
 
-void Checker::removeItem(std::unordered_set<ItemNode *> &remove) {
+void Checker::removeItem() {
+  // single compaction of every item marked during collection
   auto &vec = Prog->children;
-  auto it = vec.begin();
-  while (it != vec.end()) {
-    if (remove.count(it->get())) {
-      it = vec.erase(it);
-    } else {
-      ++it;
-    }
-  }
+  vec.erase(std::remove_if(vec.begin(), vec.end(),
+                           [](const std::shared_ptr<ItemNode> &item) {
+                             return item->isRemoved();
+                           }),
+            vec.end());
 }
 
-void Checker::initRun() {
-  std::vector<std::shared_ptr<ItemNode>> nestedItems;
-  for (auto &item : Prog->children) {
-    if (item->getTypeID() != ASTNode::K_ItemFn) continue;
-    ItemFn &itemFn = dynamic_cast<ItemFn &>(*item);
-    if (itemFn.block_expr == nullptr) continue;
-    auto &stmts = itemFn.block_expr->stmts;
-    auto it = stmts.begin();
-    while (it != stmts.end()) {
-      if (it->get()->getTypeID() != ASTNode::K_StmtItem) {
-        it++;
-        continue;
-      }
-      StmtItem &stmtItem = dynamic_cast<StmtItem&>(*it->get());
+void Checker::hoistNestedItems(ItemFn &N) {
+  if (N.block_expr == nullptr) return;
+  auto &stmts = N.block_expr->stmts;
+  std::vector<std::shared_ptr<StmtNode>> kept;
+  kept.reserve(stmts.size());
+  for (auto &stmt : stmts) {
+    if (stmt->getTypeID() == ASTNode::K_StmtItem) {
+      auto &stmtItem = dynamic_cast<StmtItem &>(*stmt);
       switch (stmtItem.item->getTypeID()) {
       // can be dealed preciously by scope
       case ASTNode::K_ItemConst:
       default:
-        it++;
         break;
       case ASTNode::K_ItemEnum:
       case ASTNode::K_ItemFn:
       case ASTNode::K_ItemImpl:
       case ASTNode::K_ItemStruct:
       case ASTNode::K_ItemTrait:
-        auto s = *it;
-        auto &item = dynamic_cast<StmtItem&>(*s);
-        nestedItems.push_back(item.item);
-        it = stmts.erase(it);
-        break;
+        // visited later by the same sweep in collectDecls
+        Prog->children.push_back(stmtItem.item);
+        continue;
       }
     }
+    kept.push_back(std::move(stmt));
   }
-  for (int i = 0; i < nestedItems.size(); ++i)
-    Prog->children.push_back(nestedItems[i]);
+  stmts.swap(kept);
+}
+
+void Checker::mergeImpl(ItemImpl &N, std::unordered_map<std::string, ItemImpl *> &Merged) {
+  std::string &traitName = N.identifier;
+  auto &typePath = dynamic_cast<TypePath &>(*N.type);
+  std::string typeName = typePath.getTypeName();
+  if (!traitName.empty()) {
+    // checked against the trait in collectSignatures
+    TraitImplSize[std::make_pair(traitName, typeName)] += N.associated_items.size();
+    // trait name is useless after merging
+    traitName.clear();
+  }
+  ItemImpl *&whichImpl = Merged[typeName];
+  if (whichImpl == nullptr) {
+    whichImpl = &N;
+    Impls.push_back(&N);
+    return;
+  }
+  // splice all items into the first impl of the struct
+  auto &items = whichImpl->associated_items;
+  items.splice(items.end(), N.associated_items);
+  N.setRemoved(true);
 }
 
-void Checker::firstRun() {
-  std::unordered_set<ItemNode *> remove;
-  std::unordered_map<std::string, ItemImpl *> inhImplInfo;// used to merge all impls for a specific struct to one
-  std::unordered_map<std::pair<std::string, std::string>, ItemImpl *, PairHash>
-      traitImplInfo;// used to merge all impls for a specific struct & trait to one
-  // visit all items in crate
-  for (auto &item : Prog->children) {
+void Checker::collectDecls() {
+  std::unordered_map<std::string, ItemImpl *> Merged;// used to merge all impls for a specific struct to one
+  // index loop: hoisted items are appended to children during the sweep
+  auto &children = Prog->children;
+  for (std::size_t i = 0; i < children.size(); ++i) {
+    ItemNode *item = children[i].get();
     switch (item->getTypeID()) {
     default:
       throw std::runtime_error("unexpected item node.");
-    case ASTNode::K_ItemFn:
-      // deal in the second run
+    case ASTNode::K_ItemFn: {
+      auto &itemFn = dynamic_cast<ItemFn&>(*item);
+      hoistNestedItems(itemFn);
+      Fns.push_back(&itemFn);
+      if (itemFn.is_const) {
+        ConstFns[itemFn.identifier] = &itemFn;
+      }
       break;
+    }
     case ASTNode::K_ItemEnum: {
       auto &enumItem = dynamic_cast<ItemEnum&>(*item);
       std::string &enumName = enumItem.identifier;
@@ -130,6 +146,7 @@ void Checker::firstRun() {
       if (!Syms.traitTable.create(itemTrait.identifier)) {
         throw std::runtime_error("duplicated trait.");
       }
+      Traits.push_back(&itemTrait);
       break;
     }
     case ASTNode::K_ItemStruct: {
@@ -140,27 +157,12 @@ void Checker::firstRun() {
       }
       const StructQualType *Ty = Syms.structTable.getTy(structName);
       itemStruct.setQualType(Ty);
+      Structs.push_back(&itemStruct);
       break;
     }
-    case ASTNode::K_ItemImpl: {
-      auto &itemImpl = dynamic_cast<ItemImpl&>(*item);
-      std::string &traitName = itemImpl.identifier;
-      auto &typePath = dynamic_cast<TypePath &>(*itemImpl.type);
-      std::string typeName = typePath.getTypeName();
-      ItemImpl *&whichImpl =
-          traitName.empty() ? inhImplInfo[typeName] : traitImplInfo[std::make_pair(traitName, typeName)];
-      if (whichImpl == nullptr) {
-        whichImpl = &itemImpl;
-      } else {
-        auto &f1 = whichImpl->associated_items;
-        auto &f2 = itemImpl.associated_items;
-        for (int i = 0; i < f2.size(); ++i)
-          f1.push_back(f2[i]);
-        // remove duplicated impl
-        remove.insert(item.get());
-      }
+    case ASTNode::K_ItemImpl:
+      mergeImpl(dynamic_cast<ItemImpl&>(*item), Merged);
       break;
-    }
     case ASTNode::K_ItemConst: {
       auto &constItem = dynamic_cast<ItemConst&>(*item);
       const QualType *Ty = getType(*constItem.type);
@@ -168,24 +170,22 @@ void Checker::firstRun() {
       if (!Syms.constTable.create(constName, Ty)) {
         throw std::runtime_error("duplicated const.");
       }
+      Consts.push_back(&constItem);
       break;
     }
     }
   }
-  // remove unnecessary item from Prog.chirldren
-  removeItem(remove);
 }
 
-void Checker::secondRun(void) {
+void Checker::solveConsts(void) {
   ConstSolver solver;
-  for (auto &item : Prog->children) {
-    if (item->getTypeID() == ASTNode::K_ItemConst) {
-      auto constItem = &dynamic_cast<ItemConst&>(*item);
-      solver.question.insert(*constItem);
-    }
+  solver.prioriKnowledge.insert(ConstFns);
+  for (auto constItem : Consts) {
+    solver.question.insert(*constItem);
   }
   if (!solver.solve()) {
-    throw std::runtime_error("const solver failed.");
+    const std::string &why = solver.getDiagnostic();
+    throw std::runtime_error(why.empty() ? "const solver failed." : why);
   }
   // get results
 
@@ -198,78 +198,36 @@ void Checker::secondRun(void) {
   }
 }
 
-void Checker::thirdRun(void) {
-  std::unordered_set<ItemNode *> remove;
-  for (auto &item : Prog->children) {
-    switch (item->getTypeID()) {
-    default: throw std::runtime_error("unexpected item node.");
-    case ASTNode::K_ItemEnum:
-    case ASTNode::K_ItemConst:
-    case ASTNode::K_ItemImpl:
-      break;
-    case ASTNode::K_ItemTrait: {
-      auto &itemTrait = dynamic_cast<ItemTrait&>(*item);
-      collectTraitMethod(itemTrait);
-      // remove trait
-      remove.insert(item.get());
-      break;
-    }
-    case ASTNode::K_ItemFn: {
-      auto &itemFn = dynamic_cast<ItemFn&>(*item);
-      collectFunction(itemFn);
-      break;
-    }
-    case ASTNode::K_ItemStruct: {
-      auto &itemStruct = dynamic_cast<ItemStruct&>(*item);
-      collectStructField(itemStruct);
-      break;
-    }
-    }
+void Checker::collectSignatures(void) {
+  for (auto itemTrait : Traits) {
+    collectTraitMethod(*itemTrait);
+    // remove trait
+    itemTrait->setRemoved(true);
   }
-  // remove unnecessary item from Prog.chirldren
-  removeItem(remove);
-}
-
-void Checker::forthRun(void) {
-  std::unordered_set<ItemNode *> remove;
-  // merge trait impl for struct to impl of struct
-  std::unordered_map<std::string, ItemImpl *> ImplInfo;
-  for (auto &item : Prog->children) {
-    if (item->getTypeID() != ASTNode::K_ItemImpl)continue;
-    auto &itemImpl = dynamic_cast<ItemImpl&>(*item);
-    std::string &traitName = itemImpl.identifier;
-    auto &typePath = dynamic_cast<TypePath &>(*itemImpl.type);
-    std::string typeName = typePath.getTypeName();
-    if (!traitName.empty()) { // trait impl
-      // trait impl for struct
-      if (!Syms.traitTable.count(traitName)) {
-        throw std::runtime_error("implement undefined trait for struct.");
-      }
-      size_t traitSize = Syms.traitTable.getTrait(traitName).size();
-      size_t traitImplSize = itemImpl.associated_items.size();
-      if (traitSize != traitImplSize) {
-        throw std::runtime_error("incompleted implementation of trait for struct.");
-      }
-      // trait name is useless
-      traitName.clear();
+  for (auto itemFn : Fns) {
+    collectFunction(*itemFn);
+  }
+  for (auto itemStruct : Structs) {
+    collectStructField(*itemStruct);
+  }
+  // check impl trait of struct
+  for (auto &[Key, Size] : TraitImplSize) {
+    const std::string &traitName = Key.first;
+    if (!Syms.traitTable.count(traitName)) {
+      throw std::runtime_error("implement undefined trait for struct.");
     }
-    collectStructMethod(itemImpl);
-    if (ImplInfo.count(typeName)) {
-      auto &itemList = ImplInfo[typeName]->associated_items;
-      auto &traitImplItem = itemImpl.associated_items;
-      for (int i = 0; i < traitImplItem.size(); ++i) {
-        itemList.push_back(traitImplItem[i]);
-      }
-      remove.insert(&itemImpl);
-    } else {
-      ImplInfo[typeName] = &itemImpl;
+    if (Syms.traitTable.getTrait(traitName).size() != Size) {
+      throw std::runtime_error("incompleted implementation of trait for struct.");
     }
   }
+  for (auto itemImpl : Impls) {
+    collectStructMethod(*itemImpl);
+  }
   // remove unnecessary item from Prog.chirldren
-  removeItem(remove);
+  removeItem();
 }
 
-void Checker::fifthRun(void) {
+void Checker::checkBodies(void) {
   for (auto &Item : Prog->children) {
     checkItemNode(*Item);
   }
@@ -401,7 +359,7 @@ void Checker::checkItemNode(ItemNode &N) {
     case ASTNode::K_ItemEnum:
       return checkItemEnum(dynamic_cast<ItemEnum&>(N));
     case ASTNode::K_ItemFn:
-      return checkItemFn(dynamic_cast<ItemFn&>(N));
+      return checkCachedItemFn(dynamic_cast<ItemFn&>(N));
     case ASTNode::K_ItemImpl:
       return checkItemImpl(dynamic_cast<ItemImpl&>(N));
     }
@@ -463,18 +421,7 @@ const QualType *Checker::checkExprNode(ExprNode &N) {
 }
 
 const QualType *Checker::checkTypeNode(TypeNode &N) {
-  switch (N.getTypeID()) {
-  default:
-    throw std::runtime_error("unexpected type node.");
-  case ASTNode::K_TypeArray:
-    return getArrayType(dynamic_cast<TypeArray&>(N));
-  case ASTNode::K_TypePath:
-    return getPathType(dynamic_cast<TypePath&>(N));
-  case ASTNode::K_TypeReference:
-    return getReferenceType(dynamic_cast<TypeReference&>(N));
-  case ASTNode::K_TypeUnit:
-    return getUnitType(dynamic_cast<TypeUnit&>(N));
-  }
+  return getType(N);
 }
 
 const QualType *Checker::checkPatternNode(PatternNode &N) {
@@ -514,26 +461,45 @@ const QualType *Checker::checkPath(Path &N) {
   }
 }
 
-void Checker::checkItemFn(ItemFn &N) {
+void Checker::checkCachedItemFn(ItemFn &N) {
+  if (!Cache) return checkItemFn(N);
+  const StructQualType *Self = dynamic_cast<const StructQualType*>(CurImplTy);
+  std::string Key = Self ? Self->getName() + "::" + N.identifier : N.identifier;
+  std::uint64_t Hash = Cache->fingerprint(N, Self);
+  if (const SemaCache::Entry *E = Cache->lookup(Key, Hash)) {
+    declareParams(N);
+    if (Cache->replay(*E, N, Syms)) return;
+    // a bad entry is a miss, check the body as if it was never cached
+  }
+  unsigned Base = LocalScope::peekID();
+  checkItemFn(N);
+  Cache->record(Key, Hash, N, Base, LocalScope::peekID() - Base);
+}
 
-  CurFunction = &N;
-  islocal = true;
-  scopes = new LocalScope;
+void Checker::declareParams(ItemFn &N) {
   if (CurImplTy) {
     bool mut = N.function_parameters.self_param.shorthand_self.is_mut;
     bool ref = N.function_parameters.self_param.shorthand_self.is_and;
     const QualType *ArgTy = ref ? PointerQualType::create(mut, CurImplTy) : CurImplTy;
-    CurFunction->createVarDecl("self", ArgTy, ref ? false : mut);
+    N.createVarDecl("self", ArgTy, ref ? false : mut);
   }
 
   for (const FnParam &I : N.function_parameters.fn_params) {
     const QualType *ArgTy = getType(*I.type);
     if (PatternIdentifier *Iden =dynamic_cast<PatternIdentifier*>(I.pattern.get())) {
-      CurFunction->createVarDecl(Iden->identifier, ArgTy, Iden->is_mut);
+      N.createVarDecl(Iden->identifier, ArgTy, Iden->is_mut);
       continue;
     }
     throw std::runtime_error("unsupported pattern in function parameter.");
   }
+}
+
+void Checker::checkItemFn(ItemFn &N) {
+
+  CurFunction = &N;
+  islocal = true;
+  scopes = new LocalScope;
+  declareParams(N);
   if (!N.getQualType()) {
     throw std::runtime_error("function has no function type.");
   }
@@ -550,6 +516,9 @@ void Checker::checkItemFn(ItemFn &N) {
       (BI.getReturnType() && !RetTy->equals(BI.getReturnType()))) {
         throw std::runtime_error("return type of function " + N.identifier + " is not match.");
       }
+  if (lastExpr) {
+    settleType(*N.block_expr, RetTy);
+  }
 
   BCtx.exitScope();
   CurFunction = nullptr;
@@ -571,10 +540,12 @@ void Checker::checkItemConst(ItemConst &N) {
 
   ConstSolver solver;
   solver.prioriKnowledge.insert(Syms.constTable);
+  solver.prioriKnowledge.insert(ConstFns);
 
   solver.question.insert(N);
   if (!solver.solve()) {
-    throw std::runtime_error("const solver failed.");
+    const std::string &why = solver.getDiagnostic();
+    throw std::runtime_error(why.empty() ? "const solver failed." : why);
   }
   auto s = solver.solution.takeItemSolution();
   const QualType *Ty = s.second.getTy();
@@ -612,6 +583,8 @@ void Checker::checkStmtLet(StmtLet &N) {
       if (!eq) {
         throw std::runtime_error("the type of let statement is not match.");
       }
+      settleType(*N.expr, LTy);
+      RTy = N.expr->getQualType();
   } else {
       throw std::runtime_error("Null type in let statement");
   }
@@ -768,13 +741,46 @@ const QualType *Checker::checkExprBlock(ExprBlock &N) {
   return N.setQualType(Ty);
 }
 
+const ExprPath *Checker::getPlaceRoot(const ExprNode &N) {
+  const ExprNode *Root = &N;
+  while (true) {
+    if (auto *G = dynamic_cast<const ExprGrouped*>(Root)) {
+      Root = G->expr.get();
+    } else if (auto *F = dynamic_cast<const ExprField*>(Root)) {
+      Root = F->expr.get();
+    } else if (auto *I = dynamic_cast<const ExprIndex*>(Root)) {
+      Root = I->array.get();
+    } else {
+      break;
+    }
+  }
+  auto *P = dynamic_cast<const ExprPath*>(Root);
+  if (!P || P->path2 || P->path1->type == PathType::Self) {
+    return nullptr;
+  }
+  return P;
+}
+
 const QualType *Checker::checkExprOpUnary(ExprOpUnary &N) {
   const QualType *Ty = checkExprNode(*N.expr);
   switch (N.type) {
-  case BORROW_: // & | &&
+  case BORROW_: { // & | &&
+    if (const ExprPath *P = getPlaceRoot(*N.expr)) {
+      CurFunction->setVarAddrTaken(P->path1->identifier);
+    }
     return N.setQualType(PointerQualType::create(false, Ty));
-  case MUT_BORROW_: // & | && mut
+  }
+  case MUT_BORROW_: { // & | && mut
+    const ExprPath *P = getPlaceRoot(*N.expr);
+    // codegen may place an immutable local in read-only memory
+    if (P && !N.expr->isMut() && CurFunction->containVarDecl(P->path1->identifier)) {
+      throw std::runtime_error("can not borrow immutable as mutable.");
+    }
+    if (P) {
+      CurFunction->setVarAddrTaken(P->path1->identifier);
+    }
     return N.setQualType(PointerQualType::create(true, Ty));
+  }
   case DEREFERENCE_: // *
     if (const PointerQualType *PTy = dynamic_cast<const PointerQualType*>(Ty)) {
       N.setMut(PTy->isMut());
@@ -815,6 +821,13 @@ const QualType *Checker::checkExprOpBinary(ExprOpBinary &N) {
       throw std::runtime_error("the type of binary operator not match");
     }
   }
+  if (N.type != SHL_ && N.type != SHR_ && N.type != SHL_EQ_ && N.type != SHR_EQ_) {
+    // a literal operand takes the type of the other one
+    settleType(*N.left, RTy);
+    settleType(*N.right, LTy);
+    LTy = N.left->getQualType();
+    RTy = N.right->getQualType();
+  }
 
   if (RTy->isPointer()) {
     const PointerQualType *PTR = dynamic_cast<const PointerQualType*>(RTy);
@@ -909,13 +922,25 @@ const QualType *Checker::checkExprArrayExpand(ExprArrayExpand &N) {
     }
   }
   
-  auto AT = ArrayQualType::create(Types[0], Length);
+  // the elements share the first type that is not a literal's
+  const QualType *ElemTy = Types[0];
+  for (const QualType *Ty : Types) {
+    if (!Ty->isIntLiteral()) {
+      ElemTy = Ty;
+      break;
+    }
+  }
+  for (auto &I : N.elements) {
+    settleType(*I, ElemTy);
+  }
+  auto AT = ArrayQualType::create(N.elements[0]->getQualType(), Length);
   return N.setQualType(AT);
 }
 
 long Checker::evaluateExprNode(ExprNode &N) {
   ConstSolver solver;
   solver.prioriKnowledge.insert(Syms.constTable);
+  solver.prioriKnowledge.insert(ConstFns);
   solver.question.insert(N);
   if (!solver.solve()) {
     throw std::runtime_error("expression can not evaluate at compile time.");
@@ -924,6 +949,91 @@ long Checker::evaluateExprNode(ExprNode &N) {
   return solution.second.getValue();
 }
 
+// whether no integer literal type is left inside Ty
+static bool isSettled(const QualType *Ty) {
+  if (const ArrayQualType *ATy = dynamic_cast<const ArrayQualType*>(Ty)) {
+    return isSettled(ATy->getElemType());
+  }
+  if (const PointerQualType *PTy = dynamic_cast<const PointerQualType*>(Ty)) {
+    return isSettled(PTy->getElemType());
+  }
+  return !Ty->isIntLiteral();
+}
+
+void Checker::settleType(ExprNode &N, const QualType *Ty) {
+  const QualType *Old = N.hasQualType() ? N.getQualType() : nullptr;
+  if (!Old || Old == Ty || isSettled(Old) || !isSettled(Ty) || !Old->equals(Ty)) {
+    return;
+  }
+  const QualType *ElemTy = Ty;
+  if (const ArrayQualType *ATy = dynamic_cast<const ArrayQualType*>(Ty)) {
+    ElemTy = ATy->getElemType();
+  } else if (!Ty->isInteger() && !Ty->isPointer()) {
+    return;
+  }
+
+  switch (N.getTypeID()) {
+  default:
+    return;
+  case ASTNode::K_ExprLiteralInt:
+    break;
+  case ASTNode::K_ExprGrouped:
+    settleType(*static_cast<ExprGrouped&>(N).expr, Ty);
+    break;
+  case ASTNode::K_ExprBlock: {
+    auto &B = static_cast<ExprBlock&>(N);
+    if (!B.expr) {
+      return;
+    }
+    settleType(*B.expr, Ty);
+    break;
+  }
+  case ASTNode::K_ExprIf: {
+    auto &If = static_cast<ExprIf&>(N);
+    settleType(*If.if_block, Ty);
+    if (If.else_block) {
+      settleType(*If.else_block, Ty);
+    }
+    break;
+  }
+  case ASTNode::K_ExprOpUnary: {
+    auto &U = static_cast<ExprOpUnary&>(N);
+    if (U.type == NEGATE_ || U.type == NOT_) {
+      settleType(*U.expr, Ty);
+      break;
+    }
+    const PointerQualType *PTy = dynamic_cast<const PointerQualType*>(Ty);
+    if ((U.type != BORROW_ && U.type != MUT_BORROW_) || !PTy) {
+      return;
+    }
+    settleType(*U.expr, PTy->getElemType());
+    // the borrow keeps its own mutability
+    Ty = PointerQualType::create(U.type == MUT_BORROW_, U.expr->getQualType());
+    break;
+  }
+  case ASTNode::K_ExprOpBinary: {
+    auto &B = static_cast<ExprOpBinary&>(N);
+    if (B.type > SHR_) {
+      return; // comparisons are bool whatever their operands
+    }
+    settleType(*B.left, Ty);
+    if (B.type != SHL_ && B.type != SHR_) {
+      settleType(*B.right, Ty);
+    }
+    break;
+  }
+  case ASTNode::K_ExprArrayExpand:
+    for (auto &E : static_cast<ExprArrayExpand&>(N).elements) {
+      settleType(*E, ElemTy);
+    }
+    break;
+  case ASTNode::K_ExprArrayAbbreviate:
+    settleType(*static_cast<ExprArrayAbbreviate&>(N).value, ElemTy);
+    break;
+  }
+  N.setQualType(Ty);
+}
+
 const QualType *Checker::checkExprArrayAbbreviate(ExprArrayAbbreviate &N) {
   const QualType *Ty = checkExprNode(*N.value);
   checkExprNode(*N.size);
@@ -952,6 +1062,7 @@ const QualType *Checker::checkExprIndex(ExprIndex &N) {
   if (!ITy->isUsize() && !ITy->isU32() && !ITy->isIntLiteral()) {
     throw std::runtime_error("index is not an unsigned integer.");
   }
+  settleType(*N.index, QualType::getUsizeType());
   N.setMut(mut);
   return N.setQualType(dynamic_cast<const ArrayQualType*>(Ty)->getElemType());
 }
@@ -972,6 +1083,7 @@ const QualType *Checker::checkExprStruct(ExprStruct &N) {
     if (!FTy->equals(STy->getFieldType(I.identifier))) {
       throw std::runtime_error("the field type of " + I.identifier +" is not match");
     }
+    settleType(*I.expr, STy->getFieldType(I.identifier));
   }
   return N.setQualType(STy);
 }
@@ -998,6 +1110,9 @@ const QualType *Checker::checkExprCall(ExprCall &N) {
                   })) {
     throw std::runtime_error("ExprCall parameter types not match.");
   }
+  for (size_t Idx = 0; Idx < N.params.size(); Idx++) {
+    settleType(*N.params[Idx], FTy->getParamTypes()[Idx]);
+  }
   N.setQualType(FTy->getReturnType());
   return FTy->getReturnType();
 }
@@ -1059,6 +1174,7 @@ const QualType *Checker::checkExprMethodCall(ExprMethodCall &N) {
       throw std::runtime_error("the type of argument " + std::to_string(Idx) +
                              " of method " + N.path->identifier + " is not match.");
     }
+    settleType(*Param, FTy);
     Idx++;
   }
   return N.setQualType(FTy->getReturnType());
@@ -1124,6 +1240,10 @@ const QualType *Checker::checkExprBreak(ExprBreak &N) {
   }
 
   BlockCtx::BlockInfo &S = BCtx.getLastScope(BlockCtx::Loop);
+  if (N.expr && S.getReturnType()) {
+    settleType(*N.expr, S.getReturnType());
+    Ty = N.expr->getQualType();
+  }
   if (S.getReturnType() && !S.getReturnType()->equals(Ty)) {
     throw std::runtime_error("the types of the two break are not match.");
   } else {
@@ -1168,6 +1288,9 @@ const QualType *Checker::checkExprIf(ExprIf &N) {
       if (!IfTy->equals(ElseTy)) {
         throw std::runtime_error("the return type of if-else expr is not match");
       }
+      settleType(*N.if_block, ElseTy);
+      settleType(*N.else_block, IfTy);
+      retTy = N.if_block->getQualType();
     } // only else block returned (do nothing)
   } else {
     retTy = QualType::getVoidType();
@@ -1189,6 +1312,8 @@ const QualType *Checker::checkExprReturn(ExprReturn &N) {
   if (!Ty->equals(RetTy)) {
     throw std::runtime_error("return type not match.");
   }
+  settleType(*N.expr, RetTy);
+  Ty = N.expr->getQualType();
 
   BlockCtx::BlockInfo &BI = BCtx.getLastScope(BlockCtx::Func);
   if (BI.getReturnType() && !BI.getReturnType()->equals(Ty)) {
@@ -1216,6 +1341,10 @@ const QualType *Checker::checkPatternReference(PatternReference &N) {
 }
 
 const QualType *Checker::getType(TypeNode &N) {
+  // a type node always denotes the same type, resolve it only once
+  if (N.getQualType()) {
+    return N.getQualType();
+  }
   switch (N.getTypeID()) {
   default:
     throw std::runtime_error("unexpected type node.");
@@ -1234,16 +1363,7 @@ const QualType *Checker::getPathType(TypePath &N) {
   const QualType *Ty;
   switch (N.path->type) {
   case PathType::Identifier: {
-    Ty = nullptr;
-    const std::string &name = N.path->identifier;
-    if (name == "bool")  Ty =  QualType::getBoolType();
-    if (name == "i32")   Ty =  QualType::getI32Type();
-    if (name == "u32")   Ty =  QualType::getU32Type();
-    if (name == "usize") Ty =  QualType::getUsizeType();
-    if (name == "isize") Ty =  QualType::getIsizeType();
-    if (name == "char")  Ty =  QualType::getCharType();
-    if (name == "str")   Ty =  StringQualType::create("");
-    if (name == "String") Ty =  PointerQualType::create(false, StringQualType::create(""));
+    Ty = QualType::getPrimitiveType(N.path->identifier);
     if (Ty) break;
     if (Syms.structTable.count(N.path->identifier)) {
       Ty = Syms.structTable.getTy(N.path->identifier);
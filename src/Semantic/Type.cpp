@@ -25,4 +25,18 @@ std::unordered_map<std::string, const EnumQualType *> EnumQualType::Instances;
 
 std::unordered_map<int64_t, IntLiteralQualType *> IntLiteralQualType::Instances;
 
-std::unordered_map<std::string, StringQualType *> StringQualType::Instances;
\ No newline at end of file
+std::unordered_map<std::string, StringQualType *> StringQualType::Instances;
+const QualType *QualType::getPrimitiveType(const std::string &Name) {
+  static const std::unordered_map<std::string, const QualType *> Primitives = {
+      {"bool", getBoolType()},
+      {"i32", getI32Type()},
+      {"u32", getU32Type()},
+      {"usize", getUsizeType()},
+      {"isize", getIsizeType()},
+      {"char", getCharType()},
+      {"str", StringQualType::create("")},
+      {"String", PointerQualType::create(false, StringQualType::create(""))},
+  };
+  auto it = Primitives.find(Name);
+  return it == Primitives.end() ? nullptr : it->second;
+}
@@ -0,0 +1,62 @@
+#!/bin/bash
+# Checks that --sema-cache never changes a verdict.
+#
+#   test/sema_cache.sh [compiler]    (default: build/main)
+#
+# Every test/semantic-*/<case> is compiled cold, warm, and warm again from a
+# cache whose recorded numbers were corrupted; all three exit codes must match.
+# Every test/sema-cache/<case> compiles <case>.v1.rx to fill the cache, then
+# <case>.v2.rx cold and warm; both must give the Verdict of the v2 header.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BIN=$(realpath "${1:-$ROOT/build/main}")
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+total=0
+failed=0
+
+compile() { # <source> [cache]
+  if [ -n "$2" ]; then
+    "$BIN" --sema-cache="$2" < "$1" > /dev/null 2>&1
+  else
+    "$BIN" < "$1" > /dev/null 2>&1
+  fi
+  echo $?
+}
+
+fail() {
+  echo "FAIL $1"
+  failed=$((failed + 1))
+}
+
+for dir in "$ROOT"/test/semantic-*/*/; do
+  name=$(basename "$dir")
+  src=$dir$name.rx
+  cache=$TMP/$name.cache
+  total=$((total + 1))
+  cold=$(compile "$src" "$cache")
+  warm=$(compile "$src" "$cache")
+  # keep every length prefix intact, so the entry loads and its replay fails
+  [ -f "$cache" ] && sed -i -E 's/_([0-9]*)[0-9]( |$)/_\1x\2/g' "$cache"
+  corrupt=$(compile "$src" "$cache")
+  if [ "$cold" != "$warm" ] || [ "$cold" != "$corrupt" ]; then
+    fail "$name: cold=$cold warm=$warm corrupt=$corrupt"
+  fi
+done
+
+for dir in "$ROOT"/test/sema-cache/*/; do
+  name=$(basename "$dir")
+  cache=$TMP/$name.v.cache
+  total=$((total + 1))
+  if grep -q '^Verdict: Pass' "$dir$name.v2.rx"; then expect=0; else expect=1; fi
+  v1=$(compile "$dir$name.v1.rx" "$cache")
+  cold=$(compile "$dir$name.v2.rx")
+  warm=$(compile "$dir$name.v2.rx" "$cache")
+  if [ "$v1" != 0 ] || [ "$cold" != "$expect" ] || [ "$warm" != "$expect" ]; then
+    fail "$name: v1=$v1 v2 cold=$cold warm=$warm, expected $expect"
+  fi
+done
+
+echo "$((total - failed))/$total passed"
+[ "$failed" = 0 ]